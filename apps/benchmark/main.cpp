@@ -0,0 +1,310 @@
+#include "renderer.h"
+#include "types.h"
+#include "io.h"
+#include "../utils/utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+
+//renders primitives and whole scenes into a NullSink and writes the timings as json.
+//every step changes the objects, so each render erases and redraws them like an animation would
+struct Result {
+    string group;
+    string name;
+    string engine;
+    size_t renders;
+    double nsPerRender; // median
+    double pointsTested; // mean per render
+    double pointsEmitted;
+    RenderStats stageSums; // ns fields summed over the renders
+};
+
+struct Benchmark {
+    string group;
+    string name;
+    function<void(Scene&)> setup; // creates the objects, they are rendered once before timing
+    function<void(Scene&, int)> step; // changes the scene for render i
+};
+
+const Vec3<float> center = {0, 0, 32};
+
+//uv sphere with rings x segments quads split into triangles
+Mesh sphereMesh(int rings, int segments, float radius) {
+    Mesh mesh;
+    for (int r = 0; r <= rings; r++) {
+        float theta = M_PI * r / rings;
+        for (int s = 0; s < segments; s++) {
+            float phi = 2 * M_PI * s / segments;
+            mesh.vertices.push_back({radius * sin(theta) * cos(phi), radius * sin(theta) * sin(phi), center.z + radius * cos(theta)});
+        }
+    }
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            int a = r * segments + s;
+            int b = r * segments + (s + 1) % segments;
+            mesh.faces.push_back({a, a + segments, b});
+            mesh.faces.push_back({b, a + segments, b + segments});
+        }
+    }
+    return mesh;
+}
+
+//one object redrawn in place, text and particles cant be translated
+Benchmark primitive(const string& name, const Geometry& geometry) {
+    auto id = make_shared<ObjectId>();
+    return {
+        "primitive", name,
+        [=](Scene& scene) { *id = scene.createObject(geometry, WHITE); },
+        [=](Scene& scene, int) { scene.setObjectGeometry(*id, geometry); }
+    };
+}
+
+vector<Benchmark> primitiveBenchmarks() {
+    vector<Benchmark> benchmarks;
+    for (float radius : {1.f, 3.f, 8.f}) {
+        benchmarks.push_back(primitive("capsule_r" + to_string((int) radius), CapsuleGeometry{{-15, -10, 20}, {15, 10, 44}, radius}));
+    }
+    for (float radius : {4.f, 12.f, 24.f}) {
+        benchmarks.push_back(primitive("sphere_r" + to_string((int) radius), SphereGeometry{center, radius}));
+    }
+    benchmarks.push_back(primitive("sphere_r24_hollow", SphereGeometry{center, 24, 2}));
+    for (float size : {8.f, 24.f, 48.f}) {
+        benchmarks.push_back(primitive("triangle_s" + to_string((int) size), TriangleGeometry{
+            {-size / 2, -size / 2, center.z - size / 2}, {size / 2, -size / 4, center.z}, {0, size / 2, center.z + size / 2}, 1
+        }));
+    }
+    for (float size : {4.f, 12.f, 24.f}) {
+        Vec3<float> half = {size, size, size};
+        benchmarks.push_back(primitive("cuboid_s" + to_string((int) size), CuboidGeometry{center - half, center + half}));
+    }
+    Vec3<float> half = {24, 24, 24};
+    benchmarks.push_back(primitive("cuboid_s24_hollow", CuboidGeometry{center - half, center + half, 2}));
+    benchmarks.push_back(primitive("cuboid_s24_wire", CuboidGeometry{center - half, center + half, 1, true}));
+    for (int rings : {6, 12, 24}) {
+        Mesh mesh = sphereMesh(rings, rings * 2, 20);
+        benchmarks.push_back(primitive("mesh_" + to_string(mesh.faces.size()) + "f_wire", MeshGeometry{mesh, true, {}, 0.6}));
+        benchmarks.push_back(primitive("mesh_" + to_string(mesh.faces.size()) + "f_solid", MeshGeometry{mesh, false, {}, 0.6}));
+    }
+    for (float size : {4.f, 8.f}) {
+        benchmarks.push_back(primitive("text_s" + to_string((int) size), TextGeometry{"VOXEL 42", {20, 0, 32}, size, 0.6}));
+    }
+    for (float radius : {1.f, 2.f}) {
+        benchmarks.push_back(primitive("particle_r" + to_string((int) radius), ParticleGeometry{center, radius}));
+    }
+    return benchmarks;
+}
+
+//the README example: a 10x10x10 grid of cuboids, all moved every render
+Benchmark cuboidGrid() {
+    auto ids = make_shared<vector<ObjectId>>();
+    float size = 4.5f;
+    auto position = [=](int i, int j, int k) -> Vec3<float> { return {22.5f - size*(i+1), 22.5f - size*(j+1), size*(k+1)}; };
+    return {
+        "scene", "cuboid_grid",
+        [=](Scene& scene) {
+            CuboidGeometry cube = {.v1 = {-size/2, -size/2, -size/2}, .v2 = {size/2, size, size/2}};
+            for (int i = 0; i < 10; i++) {
+                for (int j = 0; j < 10; j++) {
+                    for (int k = 0; k < 10; k++) {
+                        ids->push_back(scene.createObject(cube, {(float) i / 9, (float) k / 9, (float) j / 9}));
+                        scene.setObjectTranslation(ids->back(), position(i, j, k));
+                    }
+                }
+            }
+        },
+        [=](Scene& scene, int step) {
+            int n = 0;
+            for (int i = 0; i < 10; i++) {
+                for (int j = 0; j < 10; j++) {
+                    for (int k = 0; k < 10; k++) {
+                        scene.setObjectTranslation((*ids)[n++], position(i, j, k) + Vec3<float>{(step % 2) * 0.5f, 0, 0});
+                    }
+                }
+            }
+        }
+    };
+}
+
+//a game tick of apps/snake: the head grows by a capsule, the tail loses one, and the apple moves now and then
+Benchmark snakeTick() {
+    struct State {
+        deque<ObjectId> segments;
+        ObjectId apple;
+    };
+    auto state = make_shared<State>();
+    const float cellSize = 8;
+    const int length = 12;
+    //walks a fixed loop through the cells so the snake never leaves the box
+    auto cell = [=](int i) -> Vec3<float> {
+        int k = ((i % 40) + 40) % 40;
+        int x = k < 10 ? k : k < 20 ? 9 : k < 30 ? 29 - k : 0;
+        int y = k < 10 ? 0 : k < 20 ? k - 10 : k < 30 ? 9 : 39 - k;
+        return {(x - 4.5f) * cellSize * 0.5f, (y - 4.5f) * cellSize * 0.5f, 32};
+    };
+    return {
+        "scene", "snake_tick",
+        [=](Scene& scene) {
+            scene.createObject(CuboidGeometry{{-23, -23, 0.5}, {23, 23, 63}, 0.7, true}, WHITE);
+            for (int i = -length; i < 0; i++) {
+                state->segments.push_back(scene.createObject(CapsuleGeometry{cell(i), cell(i + 1), cellSize * 0.4f}, i % 2 ? GREEN : BLUE));
+            }
+            state->apple = scene.createObject(SphereGeometry{{10, 10, 20}, cellSize * 0.4f}, RED);
+        },
+        [=](Scene& scene, int i) {
+            scene.removeObject(state->segments.front());
+            state->segments.pop_front();
+            state->segments.push_back(scene.createObject(CapsuleGeometry{cell(i), cell(i + 1), cellSize * 0.4f}, i % 2 ? GREEN : BLUE));
+            if (i % 8 == 0) {
+                scene.setObjectTranslation(state->apple, {(float) (i % 3) * 4, 0, (float) (i % 5) * 4});
+            }
+        }
+    };
+}
+
+//a mesh drawn as wireframe like apps/showObj, turning a little every render
+Benchmark objWireframe(const string& objPath) {
+    auto id = make_shared<ObjectId>();
+    Mesh mesh;
+    if (objPath.empty()) {
+        mesh = sphereMesh(16, 32, 20);
+    } else {
+        mesh = loadMeshObj(objPath);
+        mesh.center(2);
+    }
+    return {
+        "scene", "obj_wireframe",
+        [=](Scene& scene) {
+            *id = scene.createObject(MeshGeometry{mesh, true, {}, 0.5}, WHITE);
+            scene.setObjectIntrinsicPivot(*id, center);
+        },
+        [=](Scene& scene, int i) { scene.setObjectRotation(*id, {0, 0, i * 0.05f}); }
+    };
+}
+
+//particles drifting through the volume, every one of them moves every render
+Benchmark particleSwarm(int count) {
+    auto ids = make_shared<vector<ObjectId>>();
+    auto positions = make_shared<vector<Vec3<float>>>();
+    auto velocities = make_shared<vector<Vec3<float>>>();
+    return {
+        "scene", "particles_" + to_string(count),
+        [=](Scene& scene) {
+            mt19937 random(count);
+            uniform_real_distribution<float> xy(-20, 20), z(8, 56), v(-0.5, 0.5);
+            for (int i = 0; i < count; i++) {
+                positions->push_back({xy(random), xy(random), z(random)});
+                velocities->push_back({v(random), v(random), v(random)});
+                ids->push_back(scene.createObject(ParticleGeometry{positions->back(), 1}, WHITE));
+            }
+        },
+        [=](Scene& scene, int) {
+            for (int i = 0; i < count; i++) {
+                Vec3<float>& pos = (*positions)[i];
+                Vec3<float>& vel = (*velocities)[i];
+                pos = pos + vel;
+                if (abs(pos.x) > 20) vel.x = -vel.x;
+                if (abs(pos.y) > 20) vel.y = -vel.y;
+                if (pos.z < 8 || pos.z > 56) vel.z = -vel.z;
+                scene.setObjectGeometry((*ids)[i], ParticleGeometry{pos, 1});
+            }
+        }
+    };
+}
+
+Result run(const Benchmark& benchmark, const UpdatePattern& pattern, DrawEngine engine, double seconds) {
+    Scene scene(SceneConfig{ .updatePattern = &pattern, .sink = make_shared<NullSink>() });
+    scene.setDrawEngine(engine);
+    benchmark.setup(scene);
+    scene.render();
+
+    vector<int64_t> times;
+    double tested = 0, emitted = 0;
+    RenderStats sums;
+    int64_t start = steadyNs();
+    for (int i = 1; times.size() < 3 || steadyNs() - start < seconds * 1e9; i++) {
+        int64_t t0 = steadyNs();
+        benchmark.step(scene, i);
+        scene.render();
+        times.push_back(steadyNs() - t0);
+        const RenderStats& stats = scene.getRenderStats();
+        tested += stats.pointsTested;
+        emitted += stats.pointsEmitted;
+        sums.transformNs += stats.transformNs;
+        sums.cellsNs += stats.cellsNs;
+        sums.testsNs += stats.testsNs;
+        sums.ditherNs += stats.ditherNs;
+        sums.diffNs += stats.diffNs;
+        sums.writeNs += stats.writeNs;
+    }
+    sort(times.begin(), times.end());
+    size_t n = times.size();
+    return {
+        benchmark.group, benchmark.name, engine == DrawEngine::SLICE_RASTER ? "slice_raster" : "point_test",
+        n, (double) times[n / 2], tested / n, emitted / n, sums
+    };
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv, argv + argc);
+    auto hasOption = [&](const string& name) { return find(args.begin(), args.end(), name) != args.end(); };
+    string filter = hasOption("-filter") ? getOption<string>("-filter", argc, argv) : "";
+    string engineName = hasOption("-engine") ? getOption<string>("-engine", argc, argv) : "both";
+    string objPath = hasOption("-obj") ? getOption<string>("-obj", argc, argv) : "";
+    string patternPath = hasOption("-pattern") ? getOption<string>("-pattern", argc, argv) : "../../update_pattern_gen/output.txt";
+    string outPath = hasOption("-o") ? getOption<string>("-o", argc, argv) : "build/benchmark.json";
+    float seconds = hasOption("-time") ? getOption<float>("-time", argc, argv) : 0.3f;
+    if (hasOption("-h")) {
+        cerr<<"usage: ./build/main [-filter substring] [-engine point|raster|both] [-time seconds] [-obj file.obj] [-pattern output.txt] [-o results.json]"<<endl;
+        return 0;
+    }
+
+    FILE* json = fopen(outPath.c_str(), "w");
+    if (json == nullptr) {
+        perror(outPath.c_str());
+        return 1;
+    }
+
+    UpdatePattern pattern = loadUpdatePattern(patternPath);
+    vector<DrawEngine> engines;
+    if (engineName != "raster") engines.push_back(DrawEngine::POINT_TEST);
+    if (engineName != "point") engines.push_back(DrawEngine::SLICE_RASTER);
+
+    vector<Benchmark> benchmarks = primitiveBenchmarks();
+    benchmarks.push_back(cuboidGrid());
+    benchmarks.push_back(snakeTick());
+    benchmarks.push_back(objWireframe(objPath));
+    benchmarks.push_back(particleSwarm(100));
+    benchmarks.push_back(particleSwarm(1000));
+
+    fprintf(json, "{\n  \"benchmarks\": [");
+    bool first = true;
+    for (const Benchmark& benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == string::npos) continue;
+        for (DrawEngine engine : engines) {
+            Result result = run(benchmark, pattern, engine, seconds);
+            double nsPerVoxel = result.pointsEmitted > 0 ? result.nsPerRender / result.pointsEmitted : 0;
+            const RenderStats& sums = result.stageSums;
+            double n = result.renders;
+            fprintf(json, "%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"engine\": \"%s\", \"renders\": %zu, "
+                "\"ns_per_render\": %.0f, \"points_tested\": %.0f, \"points_emitted\": %.0f, \"ns_per_voxel\": %.2f, "
+                "\"stages_ns\": {\"transform\": %.0f, \"cells\": %.0f, \"tests\": %.0f, \"dither\": %.0f, \"diff\": %.0f, \"write\": %.0f}}",
+                first ? "" : ",", result.group.c_str(), result.name.c_str(), result.engine.c_str(), result.renders,
+                result.nsPerRender, result.pointsTested, result.pointsEmitted, nsPerVoxel,
+                sums.transformNs / n, sums.cellsNs / n, sums.testsNs / n, sums.ditherNs / n, sums.diffNs / n, sums.writeNs / n);
+            fflush(json);
+            first = false;
+            fprintf(stderr, "%-24s %-12s %10.3f ms %10.0f tested %9.0f lit %8.2f ns/voxel\n",
+                result.name.c_str(), result.engine.c_str(), result.nsPerRender / 1e6, result.pointsTested, result.pointsEmitted, nsPerVoxel);
+        }
+    }
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+    fprintf(stderr, "wrote %s\n", outPath.c_str());
+}
@@ -1,30 +1,28 @@
 #include "../../renderer/include/renderer.h"
 #include "../../renderer/include/types.h"
 #include "../../renderer/include/io.h"
+#include "../../renderer/include/animation.h"
 #include <iostream>
-#include <filesystem>
-#include <unistd.h>
-#include <chrono>
+#include <memory>
 
 int main() {
-    using namespace std::chrono;
-
     Scene scene = Scene();
     SphereGeometry G = {.pos = {0, 0, 32}, .radius=6};
     auto sphere = scene.createObject(G, RED);
     printf("created object");
-    //scene.render();
-    //scene.setObjectTranslation(sphere, {1, 0, 0});
-    //scene.render();
-    //scene.setObjectTranslation(sphere, {0, 0.5, 0});
-    int i = 0;
+
+    //swings from side to side and back every 6 seconds, sampled by every render
+    auto swing = make_shared<Animation>(Animation{
+        .translation = { .keys = {
+            { 0, {-30, 0, 0}, Easing::SMOOTH },
+            { 3, {30, 0, 0}, Easing::SMOOTH },
+            { 6, {-30, 0, 0} },
+        } },
+        .loop = true,
+    });
+    scene.animateObject(sphere, swing);
     while(true) {
-        auto start = steady_clock::now();
-        usleep(10000);
-        scene.setObjectTranslation(sphere, {static_cast<float>(sin(i/100.) * 30.), 0, 0});
+        scene.waitForRevolution();
         scene.render();
-        i++;
-        auto fps = 1/duration<double>(steady_clock::now() - start).count();
-        printf("fps: %f\n", fps);
     }
-}   
\ No newline at end of file
+}
@@ -14,6 +14,6 @@ int main() {
             printf("%c, ", key);
         }
         cout<<endl;
-        sleep(2);
+        scene.waitForKeys();
     }
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "shm.h"
+#include "vdv.h"
+#include "../utils/utils.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+//plays a .vdv video through the driver's frame queue, each frame is shown from the first revolution at or after its time
+const int64_t startDelayNs = 100000000; // room to queue the first frames
+
+int64_t steadyNow() {
+    return chrono::steady_clock::now().time_since_epoch().count();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr<<"usage: ./build/main video.vdv [-loop] [-speed factor]"<<endl;
+        return 1;
+    }
+    vector<string> args(argv, argv + argc);
+    bool loop = find(args.begin(), args.end(), "-loop") != args.end();
+    float speed = 1;
+    if (find(args.begin(), args.end(), "-speed") != args.end()) {
+        speed = getOption<float>("-speed", argc, argv);
+        if (!(speed > 0)) {
+            cerr<<"-speed has to be above 0"<<endl;
+            return 1;
+        }
+    }
+
+    VdvReader video;
+    if (!video.open(args[1]) || video.frameCount() == 0) {
+        cerr<<"nothing to play in "<<args[1]<<endl;
+        return 1;
+    }
+    printf("%zu frames, %.2f s\n", video.frameCount(), video.duration() / 1e9);
+
+    ShmLayout* shmPointer = openShm("vdshm");
+    if (shmPointer == nullptr) return 1;
+    resetFrameQueue(shmPointer);
+
+    int64_t start = steadyNow() + startDelayNs;
+    size_t skipped = 0;
+    do {
+        for (size_t frame = 0; frame < video.frameCount(); frame++) {
+            int64_t presentTime = start + (int64_t) (video.frameTime(frame) / speed);
+            //behind by more than a frame, the driver would drop it anyway
+            if (frame + 1 < video.frameCount() && start + (int64_t) (video.frameTime(frame + 1) / speed) <= steadyNow()) {
+                skipped++;
+                continue;
+            }
+            const ShmVoxelSlice* slices = video.readFrame(frame);
+            if (slices == nullptr) return 1;
+
+            int slot = waitQueuedFrame(shmPointer);
+            copy(slices, slices + 2000, shmPointer->frameQueue.frames[slot].data.begin());
+            submitQueuedFrame(shmPointer, slot, presentTime);
+        }
+        start += (int64_t) (video.duration() / speed);
+    } while (loop);
+
+    printf("done, %zu frames skipped\n", skipped);
+}
@@ -2,6 +2,7 @@
 #include <chrono>
 #include <thread>
 #include <random>
+#include <deque>
 #include "renderer.h"
 #include "types.h"
 
@@ -80,6 +81,15 @@ Snake buildSnake(const vector<Vec3<int>>& snakePositions, Scene& scene) {
     return res;
 }
 
+//every press since the last call becomes a turn, so quick presses between two steps arent lost
+void queueTurns(Scene& scene, deque<Vec3<int>>& pendingTurns) {
+    for (auto event : scene.pollKeyEvents()) {
+        if (inputMoveMap.find(event.key) != inputMoveMap.end()) {
+            pendingTurns.push_back(inputMoveMap[event.key]);
+        }
+    }
+}
+
 Vec3<int> getNewApplePos(Snake snake) {
     Vec3<int> res;
     while (true) {
@@ -194,6 +204,7 @@ int main() {
     }, scene);
 
     Vec3<int> movementDirection = inputMoveMap['i'];
+    deque<Vec3<int>> pendingTurns; // every press counts, one turn per step
     
     Vec3<int> applePos = getNewApplePos(snake);
 
@@ -206,15 +217,13 @@ int main() {
     bool running = true;
     int appleCount = 0;
     while (running) {
-        auto keys = scene.getPressedKeys();
-
-        for (int keyIndex = keys.size()-1; keyIndex >= 0; keyIndex--) {
-            if (inputMoveMap.find(keys[keyIndex]) != inputMoveMap.end()) {
-                auto newDirection = inputMoveMap[keys[keyIndex]];
-                if (not (newDirection == (movementDirection * -1.0f))) { 
-                    movementDirection = newDirection;
-                    break;
-                }
+        queueTurns(scene, pendingTurns);
+        while (!pendingTurns.empty()) {
+            auto newDirection = pendingTurns.front();
+            pendingTurns.pop_front();
+            if (not (newDirection == movementDirection) and not (newDirection == (movementDirection * -1.0f))) {
+                movementDirection = newDirection;
+                break;
             }
         }
         
@@ -308,6 +317,7 @@ int main() {
             }
             scene.render();
             this_thread::sleep_for(chrono::milliseconds(frameSleepMs));
+            queueTurns(scene, pendingTurns);
         }
 
         cout << "new player pos" << headPos << endl;
@@ -58,6 +58,14 @@ pressed_keys: list[Key_stroke]
 async def read_index():
     return FileResponse('../index.html')
 
+@app.get("/driverstats/")
+async def get_driver_stats():
+    return shm.read_driver_stats()
+
+@app.get("/renderstats/")
+async def get_render_stats():
+    return shm.read_render_stats()
+
 @app.get("/keystrokes/")
 async def get_pressed_keys():
     return pressed_keys
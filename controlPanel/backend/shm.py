@@ -1,9 +1,11 @@
 from multiprocessing import shared_memory
 import ctypes
 import gc
+import platform
+import time
 
 SHM_SIGNATURE = 0xB0B
-SHM_VERSION = 1
+SHM_VERSION = 3 # same as SHM_VERSION in shm.h
 
 class Header(ctypes.Structure):
     _fields_ = [
@@ -23,15 +25,164 @@ class ShmVoxelSlice(ctypes.Structure):
 
 ShmVoxelFrame = ShmVoxelSlice * 2000 
 
-class ShmLayout(ctypes.Structure):
+class ShmPackedSlice(ctypes.Structure):
+    _fields_ = [
+        ("index1", ctypes.c_uint8),        # 1 byte
+        ("index2", ctypes.c_uint8),        # 1 byte (+2 padding)
+        ("rows", ctypes.c_uint32 * 64)     # gpio set-masks, see shm/gpioPacking.h
+    ]
+    # Total size: 260 bytes
+
+ShmPackedFrame = ShmPackedSlice * 2000
+
+LATENESS_BUCKETS = 16
+LATENESS_BUCKET_NS = 2000
+
+class ShmDriverStats(ctypes.Structure):
+    _fields_ = [
+        ("sequence", ctypes.c_uint32),     # odd while the driver updates the block
+        ("revolutions", ctypes.c_uint32),
+        ("slices", ctypes.c_uint64),
+        ("overruns", ctypes.c_uint64),
+        ("latenessHistogram", ctypes.c_uint64 * LATENESS_BUCKETS),
+        ("worstLateness", ctypes.c_int64), # last revolution, ns
+        ("lastOverruns", ctypes.c_uint32),
+        ("worstSlice", ctypes.c_uint16)
+    ]
+    # Total size: 168 bytes
+
+class ShmRenderStats(ctypes.Structure):
+    _fields_ = [
+        ("sequence", ctypes.c_uint32),     # odd while an app updates the block
+        ("pid", ctypes.c_uint32),          # app that rendered last
+        ("renders", ctypes.c_uint64),
+        ("pointsTested", ctypes.c_uint64),
+        ("pointsEmitted", ctypes.c_uint64),
+        ("pointsErased", ctypes.c_uint64),
+        ("objectsRedrawn", ctypes.c_uint32),
+        ("objects", ctypes.c_uint32),
+        ("transformNs", ctypes.c_int64),
+        ("cellsNs", ctypes.c_int64),
+        ("testsNs", ctypes.c_int64),
+        ("ditherNs", ctypes.c_int64),
+        ("diffNs", ctypes.c_int64),
+        ("writeNs", ctypes.c_int64),
+        ("totalNs", ctypes.c_int64)
+    ]
+    # Total size: 104 bytes
+
+class ShmRotation(ctypes.Structure):
+    _fields_ = [
+        ("time", ctypes.c_int64),          # steady_clock ns of the last interrupter edge
+        ("phase", ctypes.c_double),        # revolutions
+        ("velocity", ctypes.c_double),     # revolutions per second
+        ("acceleration", ctypes.c_double)  # revolutions per second^2
+    ]
+    # Total size: 32 bytes
+
+class ShmTiming(ctypes.Structure):
     _fields_ = [
-        ("header", Header),
         ("nextFrameStart", ctypes.c_int64),
         ("nextFrameDuration", ctypes.c_int64),
+        ("rotation", ShmRotation)
+    ]
+
+class ShmTimingRecord(ctypes.Structure):
+    _fields_ = [
+        ("sequence", ctypes.c_uint32),     # odd while the speed regulator writes
+        ("timing", ShmTiming)
+    ]
+    # Total size: 56 bytes
+
+class ShmNotify(ctypes.Structure):
+    _fields_ = [
+        ("revolution", ctypes.c_uint32),   # futex words, see shm/shm.h
+        ("frame", ctypes.c_uint32),
+        ("key", ctypes.c_uint32),
+        ("frameQueue", ctypes.c_uint32)
+    ]
+
+KEY_EVENT_CAPACITY = 64
+
+class ShmKeyEvent(ctypes.Structure):
+    _fields_ = [
+        ("sequence", ctypes.c_uint32),     # index of the event + 1 once written
+        ("key", ctypes.c_uint8),           # (+3 padding)
+        ("time", ctypes.c_int64)           # steady_clock ns, same clock as time.monotonic_ns()
+    ]
+    # Total size: 16 bytes
+
+class ShmKeyEventRing(ctypes.Structure):
+    _fields_ = [
+        ("head", ctypes.c_uint32),         # (+4 padding)
+        ("events", ShmKeyEvent * KEY_EVENT_CAPACITY)
+    ]
+    # Total size: 1032 bytes
+
+FRAME_QUEUE_LENGTH = 4
+
+class ShmQueuedFrame(ctypes.Structure):
+    _fields_ = [
+        ("state", ctypes.c_uint32),        # free, writing, ready, showing (+4 padding)
+        ("presentTime", ctypes.c_int64),   # steady_clock ns
+        ("data", ShmVoxelFrame)
+    ]
+    # Total size: 516016 bytes
+
+class ShmFrameQueue(ctypes.Structure):
+    _fields_ = [
+        ("showing", ctypes.c_uint32),      # slot the driver shows, 0xFFFFFFFF for data
+        ("showingFrame", ctypes.c_uint32),
+        ("frames", ShmQueuedFrame * FRAME_QUEUE_LENGTH)
+    ]
+    # Total size: 2064072 bytes
+
+LAYER_COUNT = 3
+DIRTY_WORDS = (2000 + 63) // 64
+
+class ShmLayer(ctypes.Structure):
+    _fields_ = [
+        ("owner", ctypes.c_uint32),        # pid of the client, 0 while free
+        ("zOrder", ctypes.c_int32),        # data sits at 0
+        ("blend", ctypes.c_uint32),        # over, add, xor, cut (+4 padding)
+        ("dirty", ctypes.c_uint64 * DIRTY_WORDS),
+        ("data", ShmVoxelFrame)
+    ]
+    # Total size: 516272 bytes
+
+class ShmLayers(ctypes.Structure):
+    _fields_ = [
+        ("dataDirty", ctypes.c_uint64 * DIRTY_WORDS),
+        ("layers", ShmLayer * LAYER_COUNT)
+    ]
+    # Total size: 1549072 bytes
+
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98, "armv7l": 240}.get(platform.machine())
+FUTEX_WAKE = 1
+INT_MAX = 2**31 - 1
+libc = ctypes.CDLL(None, use_errno=True)
+
+FRAME_FORMAT_VOXEL_BYTES = 0
+FRAME_FORMAT_PACKED_GPIO = 1
+
+class ShmLayout(ctypes.Structure):
+    _fields_ = [
+        ("header", Header),
+        ("timing", ShmTimingRecord),
         ("keyboardState", ctypes.c_uint8 * 8), #actually are chars, but i encountered some bugs
         ("data", ShmVoxelFrame),
-        ("padding", ctypes.c_uint8 * 8)
+        ("frameFormat", ctypes.c_uint32),
+        ("packedData", ShmPackedFrame),
+        ("padding1", ctypes.c_uint8 * 4),
+        ("driverStats", ShmDriverStats),
+        ("notify", ShmNotify),
+        ("keyEvents", ShmKeyEventRing),
+        ("frameQueue", ShmFrameQueue),
+        ("layers", ShmLayers),
+        ("renderStats", ShmRenderStats),
+        ("padding2", ctypes.c_uint8 * 24)
     ]
+    # Total size: 4650624 bytes (multiple of 64 like the c++ struct)
     
 class Shm:
     def __init__(self, name):
@@ -39,6 +190,7 @@ class Shm:
         self.size = ctypes.sizeof(ShmLayout)
         self.shm = None
         self.layout = None
+        self.last_key_timestamp = 0 # browser timestamp of the newest press already pushed as an event
         
     def create(self):
         try:
@@ -57,6 +209,10 @@ class Shm:
         self.layout.header.version = SHM_VERSION
         
     
+    def layout_matches(self):
+        # the driver writes its own header, another version means it was built with another ShmLayout
+        return self.layout is not None and self.layout.header.signature == SHM_SIGNATURE and self.layout.header.version == SHM_VERSION
+
     def write_keys(self, key_strokes):
         print(f"Python Layout Size: {ctypes.sizeof(ShmLayout)}")
         print(f"Offset of keyboardState: {ShmLayout.keyboardState.offset}")
@@ -64,8 +220,8 @@ class Shm:
         
         #Python Layout Size: 516088
         #Offset of keyboardState: 80
-        if not self.layout:
-            print("layout is none")
+        if not self.layout_matches():
+            print("layout is none or from another version")
             return
         raw_keys = (ctypes.c_uint8*8)()
         ctypes.memset(ctypes.addressof(self.layout.keyboardState), 0, 8)
@@ -74,10 +230,103 @@ class Shm:
             print(type(key.key_code))
             raw_keys[i] = ord(key.key_code) #ignore timestamp for now
         self.layout.keyboardState = raw_keys
+
+        # the page resends its whole key list on every press, the ones newer than last time are the new presses
+        for key in sorted(key_strokes, key=lambda k: k.timestamp):
+            if key.timestamp <= self.last_key_timestamp: continue
+            self.last_key_timestamp = key.timestamp
+            if len(key.key_code) != 1: continue
+            self.push_key_event(ord(key.key_code))
+        self.notify_all("key")
         
         for k in self.layout.keyboardState:
             print(chr(k))
     
+    def push_key_event(self, key):
+        # same steps as pushKeyEvent in shm.cpp: invalidate the slot, fill it, publish sequence, then head
+        ring = self.layout.keyEvents
+        head = ring.head
+        slot = ring.events[head % KEY_EVENT_CAPACITY]
+        slot.sequence = 0
+        slot.key = key & 0xFF
+        slot.time = time.monotonic_ns()
+        slot.sequence = (head + 1) % 2**32
+        ring.head = (head + 1) % 2**32
+
+    def notify_all(self, word):
+        # bump a futex word and wake every process blocked on it, like notifyAll in shm.cpp
+        setattr(self.layout.notify, word, (getattr(self.layout.notify, word) + 1) % 2**32)
+        if SYS_FUTEX is None:
+            return
+        address = ctypes.addressof(self.layout.notify) + getattr(ShmNotify, word).offset
+        libc.syscall(SYS_FUTEX, ctypes.c_void_p(address), FUTEX_WAKE, INT_MAX, None, None, 0)
+
+    def read_timing(self):
+        if not self.layout_matches():
+            return None
+        record = self.layout.timing
+        for _ in range(1000): # the speed regulator only holds the record for a moment
+            sequence = record.sequence
+            if sequence % 2 == 1:
+                continue
+            copy = ShmTiming.from_buffer_copy(record.timing)
+            if record.sequence == sequence:
+                return copy
+        return None
+
+    def read_driver_stats(self):
+        if not self.layout_matches():
+            return None
+        stats = self.layout.driverStats
+        for _ in range(1000): # the driver only holds the block for a moment, unless it died mid update
+            sequence = stats.sequence
+            if sequence % 2 == 1:
+                continue
+            copy = ShmDriverStats.from_buffer_copy(stats)
+            if stats.sequence == sequence:
+                return {
+                    "revolutions": copy.revolutions,
+                    "slices": copy.slices,
+                    "overruns": copy.overruns,
+                    "latenessHistogramNs": [(i * LATENESS_BUCKET_NS, n) for i, n in enumerate(copy.latenessHistogram)],
+                    "worstLatenessNs": copy.worstLateness,
+                    "worstSlice": copy.worstSlice,
+                    "lastOverruns": copy.lastOverruns,
+                }
+        return None
+
+    def read_render_stats(self):
+        if not self.layout_matches():
+            return None
+        stats = self.layout.renderStats
+        for _ in range(1000):
+            sequence = stats.sequence
+            if sequence % 2 == 1:
+                continue
+            copy = ShmRenderStats.from_buffer_copy(stats)
+            if stats.sequence == sequence:
+                if copy.renders == 0:
+                    return None # no app rendered yet
+                return {
+                    "pid": copy.pid,
+                    "renders": copy.renders,
+                    "objects": copy.objects,
+                    "objectsRedrawn": copy.objectsRedrawn,
+                    "pointsTested": copy.pointsTested,
+                    "pointsEmitted": copy.pointsEmitted,
+                    "pointsErased": copy.pointsErased,
+                    "stagesNs": {
+                        "transform": copy.transformNs,
+                        "cells": copy.cellsNs,
+                        "tests": copy.testsNs,
+                        "dither": copy.ditherNs,
+                        "diff": copy.diffNs,
+                        "write": copy.writeNs,
+                    },
+                    "totalNs": copy.totalNs,
+                }
+        return None
+
     def close(self):
         if self.shm == None:
             print("shm not created yet")
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include "shm.h"
+
+//merges the client layers and the base frame into a frame of its own, once per revolution.
+//only slices marked dirty by a writer are merged again, so an overlay doesnt cost the app below it anything
+class Compositor {
+    struct LayerSetup {
+        uint32_t owner;
+        int32_t zOrder;
+        ShmBlendMode blend;
+        bool operator==(const LayerSetup&) const = default;
+    };
+
+    std::vector<ShmVoxelSlice> output = std::vector<ShmVoxelSlice>(2000);
+    std::array<LayerSetup, LAYER_COUNT> setups = {}; // as of the last compose
+    bool composing = false;
+    bool takesDirty; // false for observers like the recorder, they must leave the dirty bits to the driver
+    int revolutions = 0;
+    //the revolution begin() started
+    volatile ShmLayout* shmPointer = nullptr;
+    const ShmVoxelFrame* base = nullptr;
+    std::vector<int> order; // layers by z order
+    ShmDirtySlices pending = {}; // slices still to merge
+
+    void composeSlice(volatile ShmLayout* shmPointer, const ShmVoxelFrame& base, const std::vector<int>& order, int sliceIndex);
+
+    public:
+        explicit Compositor(bool takesDirty_ = true) : takesDirty(takesDirty_) {}
+
+        //starts a revolution: takes the dirty bits and the layer setup, merges nothing yet.
+        //baseReplaced means base is another frame than last time, e.g. a queued one
+        void begin(volatile ShmLayout* shmPointer, const ShmVoxelFrame& base, bool baseReplaced);
+        //a slice of the frame to show, merged right now if it changed. the driver calls it just before the slice
+        //goes out, so a full redraw is spread over the revolution instead of delaying its first slices
+        const ShmVoxelSlice& slice(int sliceIndex);
+        //the whole frame at once, base itself while no layer is in use. for observers like the recorder
+        const ShmVoxelSlice* compose(volatile ShmLayout* shmPointer, const ShmVoxelFrame& base, bool baseReplaced);
+        bool isComposing() const { return composing; }
+};
@@ -13,12 +13,14 @@ class ColorInterface {
         std::array<int, 6> pinNums2;
         int clockPinNum;
         void pushColor(int c11, int c12, int c21, int c22);
+        void pushPacked(uint32_t regVal); // regVal already holds the color pin bits, see gpioPacking.h
     ColorInterface (std::array<int, 6> ColorPins1, std::array<int, 6> ColorPins2, int clockPin);
 };
 class AddressInterface {
     public:
         std::array<int, 5> addressPins;
         void setAddress(int address);
+        void addressMasks(int address, uint32_t& set, uint32_t& clear) const; // pin words setAddress would write
     AddressInterface(std::array<int, 5> pins);
 };
 class OutputInterface {
@@ -29,8 +31,8 @@ class OutputInterface {
         void latch();
     OutputInterface(int latchPin_, int oePin_);
 };
-void busy_wait_nanos(long nanos);
-void tiny_wait(int n);
+void writePins(uint32_t set, uint32_t clear);
+void busy_wait_nanos(long nanos); // see timing.h for deadlines and short delays
 void cleanup();
 void setup_io();
 #endif
\ No newline at end of file
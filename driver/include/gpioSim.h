@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "shm.h"
+
+//in-memory gpio backend, built with -DGPIO_SIM instead of mapping /dev/mem.
+//every SET/CLR write is recorded with a timestamp and can be decoded back into slices
+
+struct GpioWrite {
+    int64_t time; // steady_clock ns
+    uint32_t mask;
+    bool isSet;
+};
+
+//stands in for the SET/CLR registers, GPIO_SET = mask records the write
+struct GpioSimRegister {
+    bool isSet;
+    void operator=(uint32_t mask) const;
+};
+
+void startGpioCapture(size_t capacity); // drops earlier writes, writes past capacity are counted but not kept
+const std::vector<GpioWrite>& gpioCapture();
+size_t droppedGpioWrites();
+
+//what the panels latched and for how long the outputs were enabled
+struct DecodedSlice {
+    ShmVoxelSlice slice;
+    int64_t latchTime;
+    int64_t outputStart = 0; // oe low
+    int64_t outputEnd = 0; // oe high
+};
+
+//replays the writes through the panel shift registers, one slice per latch
+std::vector<DecodedSlice> decodeGpioCapture(const std::vector<GpioWrite>& writes);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include "shm.h"
+
+//slice timing of the output thread. counted locally, the shm block is only written once per revolution
+class SliceStats {
+    ShmDriverStats counts = {};
+    volatile ShmDriverStats& shared;
+    int64_t worstLateness = 0;
+    int worstSlice = 0;
+    uint32_t revolutionOverruns = 0;
+
+    void publish() {
+        counts.worstLateness = worstLateness;
+        counts.worstSlice = worstSlice;
+        counts.lastOverruns = revolutionOverruns;
+
+        shared.sequence = shared.sequence + 1;
+        std::atomic_thread_fence(std::memory_order_release);
+        counts.sequence = shared.sequence;
+        const_cast<ShmDriverStats&>(shared) = counts;
+        std::atomic_thread_fence(std::memory_order_release);
+        shared.sequence = counts.sequence + 1;
+    }
+
+    public:
+        SliceStats(volatile ShmDriverStats& shared_) : shared(shared_) {
+            shared.sequence = 0;
+            publish();
+        }
+
+        //showTime is when the slice started waiting in showUntil, after its rows were pushed
+        inline void record(int sliceIndex, int64_t startTime, int64_t endTime, int64_t showTime) {
+            int64_t lateness = showTime - startTime;
+            int bucket = (int) std::clamp<int64_t>(lateness / LATENESS_BUCKET_NS, 0, LATENESS_BUCKETS - 1);
+            counts.latenessHistogram[bucket]++;
+            counts.slices++;
+            if (showTime >= endTime) {
+                counts.overruns++;
+                revolutionOverruns++;
+            }
+            if (lateness > worstLateness || sliceIndex == 0) {
+                worstLateness = lateness;
+                worstSlice = sliceIndex;
+            }
+            if (sliceIndex + 1 == std::tuple_size<ShmVoxelFrame>::value) {
+                counts.revolutions++;
+                publish();
+                revolutionOverruns = 0;
+            }
+        }
+};
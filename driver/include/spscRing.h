@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+//lock-free ring between exactly one producer thread and one consumer thread
+template<typename T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of 2");
+
+    std::array<T, N> slots;
+    alignas(64) std::atomic<size_t> head = 0; // next slot to read, only the consumer writes it
+    alignas(64) std::atomic<size_t> tail = 0; // next slot to write, only the producer writes it
+
+    public:
+        //producer side, false if the ring is full
+        bool tryPush(const T& value) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == N) return false;
+            slots[t % N] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        //consumer side, nullptr if the ring is empty. the slot stays valid until pop()
+        T* front() {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return nullptr;
+            return &slots[h % N];
+        }
+        void pop() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//cycle counter time source calibrated against steady_clock, so deadlines from shm (steady_clock ns)
+//can be checked without a clock call per spin and short delays dont depend on compiler flags or cpu frequency
+
+//raw counter: CNTVCT_EL0 on arm64 (54 MHz on the Pi 4), TSC on x86, steady_clock ns elsewhere
+inline uint64_t readCounter() {
+#if defined(__aarch64__)
+    uint64_t value;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(value) :: "memory");
+    return value;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct TimingCalibration {
+    double ticksPerNs = 1;
+    int64_t steadyBase = 0; // steady_clock ns ...
+    uint64_t counterBase = 0; // ... at this counter value
+};
+
+//only read and resynced by the thread that waits on deadlines
+extern TimingCalibration timingCalibration;
+
+void calibrateTiming(); // measures the counter rate, called by setup_io
+void resyncTiming(); // moves the bases to now so rate error cannot build up, cheap
+
+//counter value at a steady_clock time in ns
+inline uint64_t counterAt(int64_t steadyNs) {
+    const TimingCalibration& c = timingCalibration;
+    return c.counterBase + (int64_t) ((steadyNs - c.steadyBase) * c.ticksPerNs);
+}
+
+//steady_clock ns from the counter
+inline int64_t nowNanos() {
+    const TimingCalibration& c = timingCalibration;
+    return c.steadyBase + (int64_t) ((int64_t) (readCounter() - c.counterBase) / c.ticksPerNs);
+}
+
+inline void spinUntilCounter(uint64_t deadline) {
+    while ((int64_t) (readCounter() - deadline) < 0) {
+        asm volatile("" ::: "memory");
+    }
+}
+
+inline void spinUntil(int64_t steadyNs) {
+    spinUntilCounter(counterAt(steadyNs));
+}
+
+//short delay of at least ns, rounded up to whole counter ticks plus one for the tick already under way
+inline void delayNanos(int64_t ns) {
+    uint64_t ticks = (uint64_t) ceil(ns * timingCalibration.ticksPerNs) + 1;
+    spinUntilCounter(readCounter() + ticks);
+}
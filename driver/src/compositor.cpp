@@ -0,0 +1,110 @@
+#include "compositor.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <signal.h>
+
+using namespace std;
+
+const int ownerCheckRevolutions = 24; // about once a second
+
+static void blendSlice(ShmVoxelSlice& out, const ShmVoxelSlice& src, ShmBlendMode blend) {
+    //the column of a slice is fixed by the update pattern, a slice nobody wrote yet just has 0
+    out.index1 = max(out.index1, src.index1);
+    out.index2 = max(out.index2, src.index2);
+    for (size_t i = 0; i < src.data.size(); i++) {
+        uint8_t color = src.data[i];
+        switch (blend) {
+            case BLEND_OVER: if (color) out.data[i] = color; break;
+            case BLEND_ADD: out.data[i] |= color; break;
+            case BLEND_XOR: out.data[i] ^= color; break;
+            case BLEND_CUT: if (color) out.data[i] = 0; break;
+        }
+    }
+}
+
+void Compositor::composeSlice(volatile ShmLayout* shmPointer, const ShmVoxelFrame& base, const vector<int>& order, int sliceIndex) {
+    ShmLayers& layers = const_cast<ShmLayers&>(shmPointer->layers);
+    ShmVoxelSlice& out = output[sliceIndex];
+    out.index1 = 0;
+    out.index2 = 0;
+    out.data.fill(0);
+    bool baseDone = false;
+    for (int layerIndex : order) {
+        ShmLayer& layer = layers.layers[layerIndex];
+        if (!baseDone && layer.zOrder >= 0) {
+            blendSlice(out, base[sliceIndex], BLEND_OVER);
+            baseDone = true;
+        }
+        blendSlice(out, layer.data[sliceIndex], layer.blend);
+    }
+    if (!baseDone) blendSlice(out, base[sliceIndex], BLEND_OVER);
+}
+
+void Compositor::begin(volatile ShmLayout* shmPointer_, const ShmVoxelFrame& base_, bool baseReplaced) {
+    shmPointer = shmPointer_;
+    base = &base_;
+    ShmLayers& layers = const_cast<ShmLayers&>(shmPointer->layers);
+
+    if (takesDirty && ++revolutions % ownerCheckRevolutions == 0) {
+        for (ShmLayer& layer : layers.layers) {
+            uint32_t owner = atomic_ref<uint32_t>(layer.owner).load(memory_order_acquire);
+            if (owner != 0 && kill(owner, 0) != 0 && errno == ESRCH) {
+                atomic_ref<uint32_t>(layer.owner).compare_exchange_strong(owner, 0, memory_order_acq_rel);
+            }
+        }
+    }
+
+    array<LayerSetup, LAYER_COUNT> current = {};
+    order.clear();
+    for (int i = 0; i < LAYER_COUNT; i++) {
+        ShmLayer& layer = layers.layers[i];
+        uint32_t owner = atomic_ref<uint32_t>(layer.owner).load(memory_order_acquire);
+        if (owner == 0) continue;
+        current[i] = { owner, layer.zOrder, layer.blend };
+        order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return current[a].zOrder < current[b].zOrder; });
+
+    ShmDirtySlices dirty = {};
+    if (takesDirty) {
+        dirty = takeDirty(layers.dataDirty);
+        for (int i : order) {
+            ShmDirtySlices layerDirty = takeDirty(layers.layers[i].dirty);
+            for (int w = 0; w < DIRTY_WORDS; w++) dirty[w] |= layerDirty[w];
+        }
+    }
+
+    if (order.empty()) {
+        composing = false;
+        setups = current;
+        return;
+    }
+    bool redrawAll = !takesDirty || baseReplaced || !composing || current != setups;
+    composing = true;
+    setups = current;
+    if (redrawAll) {
+        pending.fill(~0ull);
+    } else {
+        pending = dirty;
+    }
+}
+
+const ShmVoxelSlice& Compositor::slice(int sliceIndex) {
+    if (!composing) return (*base)[sliceIndex];
+    uint64_t bit = 1ull << (sliceIndex % 64);
+    if (pending[sliceIndex / 64] & bit) {
+        pending[sliceIndex / 64] &= ~bit;
+        composeSlice(shmPointer, *base, order, sliceIndex);
+    }
+    return output[sliceIndex];
+}
+
+const ShmVoxelSlice* Compositor::compose(volatile ShmLayout* shmPointer_, const ShmVoxelFrame& base_, bool baseReplaced) {
+    begin(shmPointer_, base_, baseReplaced);
+    if (!composing) return base->data();
+    for (size_t s = 0; s < output.size(); s++) {
+        slice(s);
+    }
+    return output.data();
+}
@@ -12,6 +12,11 @@
 #include <iomanip>
 #include <array>
 #include "displayControl.h"
+#include "log.h"
+#include "timing.h"
+#ifdef GPIO_SIM
+#include "gpioSim.h"
+#endif
 
 using namespace std;
 using namespace std::chrono;
@@ -31,25 +36,37 @@ volatile unsigned *gpio;
 #define OUT_GPIO(g) *(gpio+((g)/10)) |=  (1<<(((g)%10)*3))
 #define SET_GPIO_ALT(g,a) *(gpio+(((g)/10))) |= (((a)<=3?(a)+4:(a)==4?3:2)<<(((g)%10)*3))
 
+#ifdef GPIO_SIM
+#define GPIO_SET GpioSimRegister{true}  // recorded, see gpioSim.h
+#define GPIO_CLR GpioSimRegister{false}
+#else
 #define GPIO_SET *(gpio+7)  // sets   bits which are 1 ignores bits which are 0
 #define GPIO_CLR *(gpio+10) // clears bits which are 1 ignores bits which are 0
+#endif
 
 #define GET_GPIO(g) (*(gpio+13)&(1<<g)) // 0 if LOW, (1<<g) if HIGH
 
 #define GPIO_PULL *(gpio+37) // Pull up/pull down
 #define GPIO_PULLCLK0 *(gpio+38) // Pull up/pull down clock
 
+//pulse widths, about what the old uncalibrated tiny_wait loops gave on the Pi 4
+const int CLOCK_HIGH_NS = 75; //adjust this for less flicker but less brightness
+const int CLOCK_LOW_NS = 15;
+const int LATCH_HIGH_NS = 30;
+const int LATCH_LOW_NS = 15;
+const int ADDRESS_SETTLE_NS = 60;
+
 const int addressPins[] = {22, 23, 24, 25, 15};
 list<int> initializedPins;
 
 void setAddress(int address) { 
     for (int i = 0; i < 5; i++) {
         if ((address>>i)%2==1) { //get nth bit of address
-            tiny_wait(20);
+            delayNanos(ADDRESS_SETTLE_NS);
             GPIO_SET = (1<<addressPins[i]);
         }
         else {
-            tiny_wait(20);
+            delayNanos(ADDRESS_SETTLE_NS);
             GPIO_CLR = (1<<addressPins[i]);
         }
     }
@@ -59,7 +76,9 @@ void cleanup() {
         GPIO_CLR = (1<<pin);
         usleep(100);
     }
+#ifndef GPIO_SIM
     munmap(gpio_map, BLOCK_SIZE);
+#endif
 }
 void pinInit(int pin, bool initialHigh=false) {
     if (pin > 27) {cleanup(); exit(-1);}
@@ -76,22 +95,8 @@ void pinInit(int pin, bool initialHigh=false) {
 
 void setup_io();
 
-static inline void spin_asm() {
-    asm("");
-}
-
 void busy_wait_nanos(long nanos) {
-    auto t1 = steady_clock::now();
-	while (duration_cast<nanoseconds>(steady_clock::now() - t1).count() < nanos - 100) {
-		spin_asm();
-	}
-}
-
-void tiny_wait(int n) {
-    volatile int sink=0;
-    for (int j = 0; j<n; ++j) {
-        sink += j;
-    }
+    delayNanos(nanos);
 }
 
 ColorInterface::ColorInterface (array<int, 6> colorPins1, array<int, 6> colorPins2, int clockPin) {
@@ -112,9 +117,17 @@ void ColorInterface::pushColor(int c11, int c12, int c21, int c22) {
                 |((c22>>2 & 1)<<pinNums2[3]) | ((c22>>1 & 1)<<pinNums2[4]) | ((c22 & 1)<<pinNums2[5]);
     GPIO_SET = regVal;
     GPIO_SET = (1<<clockPinNum);
-    tiny_wait(25); //adjust this for less flicker but less brightness
+    delayNanos(CLOCK_HIGH_NS);
     GPIO_CLR = regVal | (1<<clockPinNum);
-    tiny_wait(5);
+    delayNanos(CLOCK_LOW_NS);
+}
+
+void ColorInterface::pushPacked(uint32_t regVal) {
+    GPIO_SET = regVal;
+    GPIO_SET = (1<<clockPinNum);
+    delayNanos(CLOCK_HIGH_NS);
+    GPIO_CLR = regVal | (1<<clockPinNum);
+    delayNanos(CLOCK_LOW_NS);
 }
 
 AddressInterface::AddressInterface(array<int, 5> pins) {
@@ -124,8 +137,13 @@ AddressInterface::AddressInterface(array<int, 5> pins) {
     }
 }
 void AddressInterface::setAddress(int address) {
-    uint32_t set = 0;
-    uint32_t clear = 0;
+    uint32_t set, clear;
+    addressMasks(address, set, clear);
+    writePins(set, clear);
+}
+void AddressInterface::addressMasks(int address, uint32_t& set, uint32_t& clear) const {
+    set = 0;
+    clear = 0;
     for (int i = 0; i < 5; i++) {
         // tiny_wait(5000);
         if ((address>>i)%2==1) { //get nth bit
@@ -134,6 +152,9 @@ void AddressInterface::setAddress(int address) {
             clear |= (1<<addressPins[i]);
         }
     }
+}
+
+void writePins(uint32_t set, uint32_t clear) {
     GPIO_SET = set;
     GPIO_CLR = clear;
 }
@@ -147,17 +168,17 @@ OutputInterface::OutputInterface(int latchPin_, int oePin_) {
 
 void OutputInterface::showUntil(int64_t stopTime) {
     GPIO_SET = (1<<latchPin);
-    tiny_wait(10);
+    delayNanos(LATCH_HIGH_NS);
     GPIO_CLR = (1<<latchPin);
     GPIO_CLR = (1<<oePin);
-    while (std::chrono::steady_clock::now().time_since_epoch().count() < stopTime) {spin_asm();}
+    spinUntil(stopTime);
     GPIO_SET = (1<<18);
 }
 void OutputInterface::latch() {
     GPIO_SET = (1<<latchPin);
-    tiny_wait(10);
+    delayNanos(LATCH_HIGH_NS);
     GPIO_CLR = (1<<latchPin);
-    tiny_wait(5);
+    delayNanos(LATCH_LOW_NS);
     
 }
 
@@ -186,16 +207,26 @@ class PinInterface {
             pinNum=pinNum_;
             pinInit(pinNum_);
         } else {
-            cout << "failed to initialize pin " << pinNum <<endl;
+            LOG_ERROR("failed to initialize pin %d", pinNum_);
         }
     }
 };
 
 
 
+#ifdef GPIO_SIM
+void setup_io() {
+    static unsigned fakeRegisters[BLOCK_SIZE / sizeof(unsigned)] = {}; // only function select writes land here
+    gpio_map = fakeRegisters;
+    gpio = fakeRegisters;
+    startGpioCapture(1<<20);
+    LOG_INFO("GPIO simulated in memory");
+    calibrateTiming();
+}
+#else
 void setup_io() {
     if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0) {
-        printf("can't open /dev/mem \n");
+        LOG_ERROR("can't open /dev/mem");
         exit(-1);
     }
     gpio_map = mmap(
@@ -209,10 +240,12 @@ void setup_io() {
     close(mem_fd);
     
     if (gpio_map == MAP_FAILED) {
-      perror("mmap");//errno also set!
+      LOG_ERROR("mmap: %s", strerror(errno));
       exit(-1);
    }
-   cout << "GPIO mapped at address " << gpio_map << endl;
+   LOG_INFO("GPIO mapped at address %p", gpio_map);
    // Always use volatile pointer!
    gpio = (volatile unsigned *)gpio_map;
-}
\ No newline at end of file
+   calibrateTiming();
+}
+#endif
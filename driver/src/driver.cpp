@@ -1,14 +1,23 @@
 #include <time.h>
 #include <chrono>
 #include "shm.h"
+#include "gpioPacking.h"
 #include "displayControl.h"
+#include "spscRing.h"
+#include "sliceStats.h"
+#include "timing.h"
+#include "compositor.h"
+#include "log.h"
+#include "trace.h"
 #include <unistd.h>
 #include<cstring>
+#include<cmath>
 #include<iostream>
 #include <cassert>    // Required for assert
 #include <typeinfo>   // Required for typeid
 #include <vector>
 #include <string>
+#include <thread>
 
 using namespace std;
 using namespace chrono_literals;
@@ -21,7 +30,7 @@ concept optionType = same_as<T, int> ||
 //passing bool returns true if the flag is present, shouldnt have true or false after
 template<optionType T>
 T getOption(string_view argname, int argc, char* argv[]) {
-    for (int i = 0; i < argc - 1; i++) {
+    for (int i = 0; i < argc; i++) {
         if (argv[i] == argname) {
             if constexpr(same_as<T, int>) {
                 if (i + 1 < argc) {
@@ -39,6 +48,132 @@ T getOption(string_view argname, int argc, char* argv[]) {
     throw invalid_argument("argument not found");
 }
 
+//one slice as the output thread writes it
+struct PreparedSlice {
+    int index;
+    uint32_t addressSet;
+    uint32_t addressClear;
+    array<uint32_t, 64> rows; // color pin words in shift order
+    int64_t startTime;
+    int64_t endTime;
+};
+
+//waits for every frame and hands its slices to emit in display order, never returns
+template<typename F>
+void prepareFrames(
+    volatile ShmLayout* shmPointer, bool usePhotointerrupterFps, int fps,
+    const AddressInterface& addressInterface1, const AddressInterface& addressInterface2,
+    F&& emit
+) {
+    volatile ShmVoxelFrame& frame = shmPointer->data;
+    volatile ShmPackedFrame& packedFrame = shmPointer->packedData;
+    int64_t lastFrameStart = 0;
+    int64_t expectedEdge = INT64_MAX;
+    Compositor compositor;
+    uint32_t lastQueued = FRAME_QUEUE_LIVE;
+    const int64_t edgeSpinNs = 1000000; // spin this long before the edge is due, a futex wakeup would make the first slices late
+
+    while (true) {
+        ShmTiming timing = readTiming(shmPointer);
+        while (lastFrameStart == timing.nextFrameStart && usePhotointerrupterFps) { //if new frame hasnt started (we are ahead), wait 
+            uint32_t seen = loadNotify(shmPointer->notify.revolution);
+            timing = readTiming(shmPointer);
+            if (lastFrameStart != timing.nextFrameStart) break;
+            int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+            if (now < expectedEdge - edgeSpinNs) {
+                waitNotify(shmPointer->notify.revolution, seen, expectedEdge == INT64_MAX ? -1 : expectedEdge - edgeSpinNs - now);
+            }
+        }
+        int64_t nextFrameStart;
+        int64_t nextFrameDuration;
+        if (usePhotointerrupterFps) {
+            nextFrameStart = timing.nextFrameStart;
+            nextFrameDuration = timing.nextFrameDuration;
+        } else {
+            nextFrameStart = chrono::time_point_cast<chrono::nanoseconds>(chrono::steady_clock::now()).time_since_epoch().count();
+            nextFrameDuration = 1000000000/fps;
+            notifyAll(shmPointer->notify.revolution); //no speed regulator to do it
+        }
+        
+        lastFrameStart = nextFrameStart;
+
+        //slice deadlines follow the predicted rotor angle, constant speed if there is no estimate
+        ShmRotation rotation = timing.rotation;
+        if (!usePhotointerrupterFps || rotation.velocity <= 0) {
+            rotation = { nextFrameStart, 0, 1e9 / nextFrameDuration, 0 };
+        }
+        double revolutionStart = round(rotation.phase);
+        //one formula for all slices of the revolution
+        rotation = rotationUpTo(rotation, revolutionStart + 1);
+        expectedEdge = timeAtPhase(rotation, revolutionStart + 1);
+
+        int64_t sliceStart = timeAtPhase(rotation, revolutionStart);
+        //frames queued for this revolution replace the live data, they are always voxel bytes
+        int64_t composeStart = traceEnabled() ? traceNow() : 0;
+        uint32_t queued = advanceFrameQueue(shmPointer, sliceStart);
+        volatile ShmVoxelFrame& baseFrame = queued == FRAME_QUEUE_LIVE ? frame : const_cast<ShmFrameQueue&>(shmPointer->frameQueue).frames[queued].data;
+        //client layers are merged over it, the dirty slices only and each one just before it is emitted
+        compositor.begin(shmPointer, const_cast<ShmVoxelFrame&>(baseFrame), queued != lastQueued);
+        lastQueued = queued;
+        if (composeStart != 0) {
+            traceComplete("begin compose", "driver", composeStart, traceNow(), "queued", queued == FRAME_QUEUE_LIVE ? -1 : (int64_t) queued, "layers", compositor.isComposing());
+        }
+        bool isPacked = queued == FRAME_QUEUE_LIVE && !compositor.isComposing() && shmPointer->frameFormat == PACKED_GPIO; //format can only change between frames
+        for (int i = 0; i < 2000; i++) {
+            PreparedSlice prepared;
+            prepared.index = i;
+            prepared.startTime = sliceStart;
+            prepared.endTime = timeAtPhase(rotation, revolutionStart + (i+1) / 2000.0);
+            sliceStart = prepared.endTime;
+
+            ShmPackedSlice packedSlice;
+            if (isPacked) {
+                packedSlice = (const_cast<ShmPackedFrame&>(packedFrame))[i];
+            } else {
+                packSlice(compositor.slice(i), packedSlice);
+            }
+            prepared.rows = packedSlice.rows;
+
+            uint32_t set1, clear1, set2, clear2;
+            addressInterface1.addressMasks(31-static_cast<int> (packedSlice.index1), set1, clear1);
+            addressInterface2.addressMasks(31-static_cast<int> (packedSlice.index2), set2, clear2);
+            prepared.addressSet = set1 | set2;
+            prepared.addressClear = clear1 | clear2;
+
+            emit(prepared);
+        }
+    }
+}
+
+//a span per shown revolution and an instant per slice that was still being pushed at its end time
+static void traceSlice(const PreparedSlice& slice, int64_t showTime) {
+    static int64_t revolutionShown = 0;
+    static int overruns = 0;
+    if (slice.index == 0) {
+        revolutionShown = showTime;
+        overruns = 0;
+    }
+    if (showTime >= slice.endTime) {
+        overruns++;
+        traceInstant("slice overrun", "driver", showTime, "slice", slice.index, "lateNs", showTime - slice.endTime);
+    }
+    if (slice.index == 1999) {
+        traceComplete("revolution", "driver", revolutionShown, slice.endTime, "overruns", overruns);
+    }
+}
+
+static inline void outputSlice(const PreparedSlice& slice, ColorInterface& colorInterface, OutputInterface& outputInterface, SliceStats& stats) {
+    if (slice.index == 0) resyncTiming();
+    writePins(slice.addressSet, slice.addressClear);
+    for (uint32_t regVal : slice.rows) {
+        colorInterface.pushPacked(regVal);
+    }
+    int64_t showTime = nowNanos();
+    stats.record(slice.index, slice.startTime, slice.endTime, showTime);
+    if (traceEnabled()) traceSlice(slice, showTime);
+    outputInterface.showUntil(slice.endTime);
+}
+
 int main(int argc, char* argv[]) {
     bool usePhotointerrupterFps = true; 
     int  fps = 0;
@@ -46,116 +181,84 @@ int main(int argc, char* argv[]) {
         fps = getOption<int>("-fps", argc, argv);
         usePhotointerrupterFps = false;
     } catch (invalid_argument& e) {
-        printf("fps value cannot be parsed\n");
+        LOG_INFO("fps value cannot be parsed");
         // usePhotointerrupterFps = false;
         // fps = 10;
     }
+    bool singleThread = getOption<bool>("-singleThread", argc, argv);
 
+    //the first log call starts the log flusher, it has to happen before the pinning below so the flusher isnt pinned too
     if (usePhotointerrupterFps) {
-        printf("Using photinterrupter for fps\n");
+        LOG_INFO("Using photinterrupter for fps");
     } else {
-        printf("Fps set to: %d\n", fps);
+        LOG_INFO("Fps set to: %d", fps);
     }
+    traceThreadName("output"); // starts the trace flusher when VDTRACE is set, also before pinning
 
+    //output thread on core 1, slices are prepared on core 2
     cpu_set_t cpus;
     CPU_ZERO(&cpus);
     CPU_SET(1, &cpus);
     if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
-        cerr << "sched_setaffinity failed: " << strerror(errno) << " (continuing)\n";
+        LOG_WARN("sched_setaffinity failed: %s (continuing)", strerror(errno));
     }
     setup_io();
 
-    array<int, 6> colorPins1 = {11, 27, 7, 8, 9, 10};
-    array<int, 6> colorPins2 = {12, 5, 6, 19, 13, 20};
-    int clockPin = 17;
-    ColorInterface colorInterface(colorPins1, colorPins2, clockPin);
+    ColorInterface colorInterface(COLOR_PINS_1, COLOR_PINS_2, CLOCK_PIN);
 
-    array<int, 5> addressPins1 = {22, 23, 24, 25, 15};
-    array<int, 5> addressPins2 = {2, 3, 21, 26, 14};
-    AddressInterface addressInterface1(addressPins1);
-    AddressInterface addressInterface2(addressPins2);
+    AddressInterface addressInterface1(ADDRESS_PINS_1);
+    AddressInterface addressInterface2(ADDRESS_PINS_2);
 
-    int latchPin = 4;
-    int oePin = 18;
-    OutputInterface outputInterface(latchPin, oePin);
+    OutputInterface outputInterface(LATCH_PIN, OE_PIN);
 
-    printf("initializing Shared memory\n");
+    LOG_INFO("initializing Shared memory");
     // volatile ShmLayout *shmPointer = openShm("vdshm");
     const Header header = {
-        .signature = 0xB0B,
-        .version = 1
+        .signature = SHM_SIGNATURE,
+        .version = SHM_VERSION
     };
     volatile ShmLayout *shmPointer = initShm(header, "vdshm");
+    shmPointer->frameFormat = VOXEL_BYTES;
+    ShmFrameQueue& frameQueue = const_cast<ShmFrameQueue&>(shmPointer->frameQueue);
+    frameQueue.showing = FRAME_QUEUE_LIVE;
+    for (auto& queuedFrame : frameQueue.frames) {
+        queuedFrame.state = QUEUED_FREE;
+    }
 
-
-    printf("a\n");
-    volatile ShmVoxelFrame& frame = shmPointer->data;
-
-    auto startTime = Time::now();
-    int frameNum = 0;
+    SliceStats stats(shmPointer->driverStats);
 
     //wait for speed regulator
-    printf("a\n");
-    while (shmPointer->nextFrameDuration == 0 && usePhotointerrupterFps) {}
-
-    int64_t lastFrameStart = 0;
-    printf("a\n");
-
-    while (true) {
+    while (usePhotointerrupterFps) {
+        uint32_t seen = loadNotify(shmPointer->notify.revolution);
+        if (readTiming(shmPointer).nextFrameDuration != 0) break;
+        waitNotify(shmPointer->notify.revolution, seen);
+    }
 
-        // printf("frame start time: %lld\n", shmPointer->nextFrameStart);
-        // printf("last frame start time: %lld\n", shmPointer->nextFrameDuration);
+    if (singleThread) {
+        LOG_INFO("Preparing and showing slices on one core");
+        prepareFrames(shmPointer, usePhotointerrupterFps, fps, addressInterface1, addressInterface2, [&](const PreparedSlice& slice) {
+            outputSlice(slice, colorInterface, outputInterface, stats);
+        });
+    }
 
-        while (lastFrameStart == shmPointer->nextFrameStart && usePhotointerrupterFps) {} //if new frame hasnt started (we are ahead), wait 
-        int64_t nextFrameStart;
-        int64_t nextFrameDuration;
-        if (usePhotointerrupterFps) {
-            nextFrameStart = shmPointer->nextFrameStart;
-            nextFrameDuration = shmPointer->nextFrameDuration;
-        } else {
-            nextFrameStart = chrono::time_point_cast<chrono::nanoseconds>(chrono::steady_clock::now()).time_since_epoch().count();
-            nextFrameDuration = 1000000000/fps;
+    static SpscRing<PreparedSlice, 8> ring; // a few slices ahead of the output
+    thread prepThread([&]() {
+        cpu_set_t prepCpus;
+        CPU_ZERO(&prepCpus);
+        CPU_SET(2, &prepCpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(prepCpus), &prepCpus) != 0) {
+            LOG_WARN("prep thread affinity failed (continuing)");
         }
-        
-        lastFrameStart = nextFrameStart;
+        traceThreadName("prepare");
+        prepareFrames(shmPointer, usePhotointerrupterFps, fps, addressInterface1, addressInterface2, [&](const PreparedSlice& slice) {
+            while (!ring.tryPush(slice)) {} //output is a few slices behind, wait for a free slot
+        });
+    });
 
-        // if (frameNum%24==0) {
-        //     printf("Frame %d\n", frameNum);
-        // }
-        printf("Frame %d\n", frameNum);
-        long frameSum = 0;
-        for (int i = 0; i < 2000; i++) {
-            const ShmVoxelSlice& slice = (const_cast<ShmVoxelFrame&>(frame))[i];
-            //265.25
-            //192.651
-            auto tfdtwav = (nextFrameDuration/2000 * (i+1) + nextFrameStart);
-            auto targetSliceEndTime = (nextFrameDuration/2000 * (i+1) + nextFrameStart);
-            // printf("frame duration: %lld ns\n", frameDurationNs.count());
-            // printf("slice duration: %lld ns\n", (frameDurationNs/2000 * (i+1)).count());
-            // printf("waiting until: %lld ms\n", chrono::time_point_cast<chrono::milliseconds>(targetSliceEndTime).time_since_epoch().count());
-
-            auto index1 = 31-static_cast<int> (slice.index1);
-            auto index2 = 31-static_cast<int> (slice.index2);
-
-            //printf("\nindex: %d\n", index1);
-            addressInterface1.setAddress(index1);
-            addressInterface2.setAddress(index2);
-
-            for(int j = 0; j < 64; j++) {
-                // if (slice.data[i] != 0) {
-                //     printf("%d ", slice.data[i]);
-                // }
-                frameSum += slice.data[0+j] + slice.data[64+j] + slice.data[128+j] + slice.data[192+j];
-                // colorInterface.pushColor(slice.data[0+j], slice.data[64+j], slice.data[128+j], slice.data[192+j]);
-                //colorInterface.pushColor(slice.data[0+j], slice.data[64+j], slice.data[128+j], slice.data[192+j]);
-                colorInterface.pushColor(slice.data[63-j], slice.data[127-j], slice.data[191-j], slice.data[255-j]);
-
-
-            }
-            outputInterface.showUntil(targetSliceEndTime);
-            // usleep(10000);
-        }
-        printf("frame sum: %ld\n", frameSum);
-        frameNum++;
+    while (true) {
+        PreparedSlice* slice = ring.front();
+        if (slice == nullptr) continue;
+        outputSlice(*slice, colorInterface, outputInterface, stats);
+        ring.pop();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,80 @@
+#include <chrono>
+#include <vector>
+#include <array>
+#include "gpioSim.h"
+#include "gpioPacking.h"
+
+using namespace std;
+
+static vector<GpioWrite> captured;
+static size_t captureCapacity = 0;
+static size_t dropped = 0;
+
+void GpioSimRegister::operator=(uint32_t mask) const {
+    if (captured.size() >= captureCapacity) {
+        dropped++;
+        return;
+    }
+    int64_t time = chrono::steady_clock::now().time_since_epoch().count();
+    captured.push_back({time, mask, isSet});
+}
+
+void startGpioCapture(size_t capacity) {
+    captured.clear();
+    captured.reserve(capacity);
+    captureCapacity = capacity;
+    dropped = 0;
+}
+
+const vector<GpioWrite>& gpioCapture() {
+    return captured;
+}
+
+size_t droppedGpioWrites() {
+    return dropped;
+}
+
+static int readAddress(uint32_t levels, const array<int, 5>& pins) {
+    int address = 0;
+    for (int i = 0; i < 5; i++) {
+        address |= (levels>>pins[i] & 1)<<i;
+    }
+    return address;
+}
+
+static uint8_t readColor(uint32_t levels, bool isDisplay1, bool isSide1) {
+    const int* pins = sidePins(isDisplay1, isSide1);
+    return (levels>>pins[0] & 1)<<2 | (levels>>pins[1] & 1)<<1 | (levels>>pins[2] & 1);
+}
+
+vector<DecodedSlice> decodeGpioCapture(const vector<GpioWrite>& writes) {
+    vector<DecodedSlice> slices;
+    uint32_t levels = 0;
+    array<uint8_t, 256> shifted = {}; // same layout as ShmVoxelSlice::data, the last row shifted in is row 0
+
+    for (const GpioWrite& write : writes) {
+        uint32_t last = levels;
+        levels = write.isSet ? levels | write.mask : levels & ~write.mask;
+        uint32_t rising = levels & ~last;
+        uint32_t falling = last & ~levels;
+
+        if (rising>>CLOCK_PIN & 1) {
+            for (int side = 0; side < 4; side++) {
+                uint8_t* rows = &shifted[side * 64];
+                for (int row = 63; row > 0; row--) rows[row] = rows[row - 1];
+                rows[0] = readColor(levels, side < 2, side % 2 == 0);
+            }
+        }
+        if (rising>>LATCH_PIN & 1) {
+            DecodedSlice decoded;
+            decoded.slice.index1 = 31 - readAddress(levels, ADDRESS_PINS_1);
+            decoded.slice.index2 = 31 - readAddress(levels, ADDRESS_PINS_2);
+            decoded.slice.data = shifted;
+            decoded.latchTime = write.time;
+            slices.push_back(decoded);
+        }
+        if (!slices.empty() && (falling>>OE_PIN & 1)) slices.back().outputStart = write.time;
+        if (!slices.empty() && (rising>>OE_PIN & 1)) slices.back().outputEnd = write.time;
+    }
+    return slices;
+}
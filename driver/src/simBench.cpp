@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "shm.h"
+#include "gpioPacking.h"
+#include "gpioSim.h"
+#include "displayControl.h"
+
+using namespace std;
+
+//runs one frame of random voxels through the slice loop on the simulated gpio backend,
+//then decodes the captured writes and checks them against the frame. build with make sim
+
+static int64_t median(vector<int64_t> values) {
+    if (values.empty()) return 0;
+    nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+static void report(const char* name, const ShmVoxelFrame& frame, double seconds) {
+    const vector<GpioWrite>& writes = gpioCapture();
+    vector<DecodedSlice> decoded = decodeGpioCapture(writes);
+
+    int wrongSlices = 0;
+    for (int i = 0; i < frame.size(); i++) {
+        if (i >= decoded.size()) {
+            wrongSlices++;
+            continue;
+        }
+        const ShmVoxelSlice& slice = decoded[i].slice;
+        if (slice.index1 != frame[i].index1 || slice.index2 != frame[i].index2 || slice.data != frame[i].data) wrongSlices++;
+    }
+
+    //clock high time and clock period of the shift registers
+    vector<int64_t> clockHigh, clockPeriod;
+    int64_t lastRise = 0, rise = 0;
+    for (const GpioWrite& write : writes) {
+        if (!(write.mask>>CLOCK_PIN & 1)) continue;
+        if (write.isSet) {
+            if (lastRise) clockPeriod.push_back(write.time - lastRise);
+            lastRise = rise = write.time;
+        } else if (rise) {
+            clockHigh.push_back(write.time - rise);
+        }
+    }
+    vector<int64_t> outputTime;
+    for (const DecodedSlice& slice : decoded) outputTime.push_back(slice.outputEnd - slice.latchTime);
+
+    printf("%s: %.0f ns per slice, %zu writes (%zu dropped), %zu slices decoded, %d wrong\n",
+        name, seconds * 1e9 / frame.size(), writes.size(), droppedGpioWrites(), decoded.size(), wrongSlices);
+    printf("  median clock high %lld ns, clock period %lld ns, latch to output end %lld ns\n",
+        (long long) median(clockHigh), (long long) median(clockPeriod), (long long) median(outputTime));
+}
+
+int main() {
+    setup_io();
+    ColorInterface colorInterface(COLOR_PINS_1, COLOR_PINS_2, CLOCK_PIN);
+    AddressInterface addressInterface1(ADDRESS_PINS_1);
+    AddressInterface addressInterface2(ADDRESS_PINS_2);
+    OutputInterface outputInterface(LATCH_PIN, OE_PIN);
+
+    static ShmVoxelFrame frame;
+    mt19937 rng(1);
+    for (ShmVoxelSlice& slice : frame) {
+        slice.index1 = rng() % 32;
+        slice.index2 = rng() % 32;
+        for (uint8_t& voxel : slice.data) voxel = rng() % 8;
+    }
+
+    //bytes packed while shifting, like the driver before packed frames
+    startGpioCapture(1<<20);
+    auto start = chrono::steady_clock::now();
+    for (const ShmVoxelSlice& slice : frame) {
+        addressInterface1.setAddress(31 - slice.index1);
+        addressInterface2.setAddress(31 - slice.index2);
+        for (int j = 0; j < 64; j++) {
+            colorInterface.pushColor(slice.data[63-j], slice.data[127-j], slice.data[191-j], slice.data[255-j]);
+        }
+        outputInterface.showUntil(0);
+    }
+    report("pushColor", frame, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+
+    //words packed ahead of time, only the output loop is timed
+    static ShmPackedFrame packedFrame;
+    for (int i = 0; i < frame.size(); i++) packSlice(frame[i], packedFrame[i]);
+    startGpioCapture(1<<20);
+    start = chrono::steady_clock::now();
+    for (const ShmPackedSlice& slice : packedFrame) {
+        uint32_t set1, clear1, set2, clear2;
+        addressInterface1.addressMasks(31 - slice.index1, set1, clear1);
+        addressInterface2.addressMasks(31 - slice.index2, set2, clear2);
+        writePins(set1 | set2, clear1 | clear2);
+        for (uint32_t regVal : slice.rows) {
+            colorInterface.pushPacked(regVal);
+        }
+        outputInterface.showUntil(0);
+    }
+    report("pushPacked", frame, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include "timing.h"
+#include "log.h"
+
+using namespace std;
+
+TimingCalibration timingCalibration;
+
+static int64_t steadyNanos() {
+    return chrono::steady_clock::now().time_since_epoch().count();
+}
+
+//steady_clock and counter read as close together as possible
+static void readPair(int64_t& steadyNs, uint64_t& counter) {
+    uint64_t bestGap = UINT64_MAX;
+    steadyNs = 0;
+    counter = 0;
+    for (int i = 0; i < 5; i++) {
+        uint64_t before = readCounter();
+        int64_t now = steadyNanos();
+        uint64_t after = readCounter();
+        if (after - before < bestGap) {
+            bestGap = after - before;
+            steadyNs = now;
+            counter = before + (after - before) / 2;
+        }
+    }
+}
+
+void calibrateTiming() {
+    int64_t steadyStart, steadyEnd;
+    uint64_t counterStart, counterEnd;
+    readPair(steadyStart, counterStart);
+    this_thread::sleep_for(50ms);
+    readPair(steadyEnd, counterEnd);
+
+    timingCalibration.ticksPerNs = (double) (counterEnd - counterStart) / (steadyEnd - steadyStart);
+    timingCalibration.steadyBase = steadyEnd;
+    timingCalibration.counterBase = counterEnd;
+    LOG_INFO("cycle counter calibrated at %.2f MHz", timingCalibration.ticksPerNs * 1000);
+}
+
+void resyncTiming() {
+    readPair(timingCalibration.steadyBase, timingCalibration.counterBase);
+}
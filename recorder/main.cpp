@@ -0,0 +1,159 @@
+#include "shm.h"
+#include "vdv.h"
+#include "compositor.h"
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace std;
+
+//records what the driver shows into a .vdv file, one frame per revolution.
+//the capture thread only copies the frame, a writer thread diffs, encodes and writes it.
+//snapshots wait in a fixed pool, if the disk cant keep up new ones are dropped instead of growing memory
+const int poolSize = 8; // frames, about 4 MB
+const int recorderCpu = 3; // the driver spins on 1 and 2
+
+volatile sig_atomic_t stopRequested = 0;
+
+struct Snapshot {
+    vector<ShmVoxelSlice> slices = vector<ShmVoxelSlice>(2000);
+    int64_t time;
+};
+
+class SnapshotPool {
+    vector<Snapshot> snapshots = vector<Snapshot>(poolSize);
+    deque<int> free;
+    deque<int> filled;
+    mutex lock;
+    condition_variable hasFilled;
+    bool closed = false;
+
+    public:
+        SnapshotPool() {
+            for (int i = 0; i < poolSize; i++) free.push_back(i);
+        }
+
+        Snapshot& at(int i) { return snapshots[i]; }
+
+        int take() { // -1 if the writer is behind
+            lock_guard<mutex> guard(lock);
+            if (free.empty()) return -1;
+            int i = free.front();
+            free.pop_front();
+            return i;
+        }
+
+        void submit(int i) {
+            {
+                lock_guard<mutex> guard(lock);
+                filled.push_back(i);
+            }
+            hasFilled.notify_one();
+        }
+
+        int next() { // blocks, -1 once closed and drained
+            unique_lock<mutex> guard(lock);
+            hasFilled.wait(guard, [&] { return !filled.empty() || closed; });
+            if (filled.empty()) return -1;
+            int i = filled.front();
+            filled.pop_front();
+            return i;
+        }
+
+        void release(int i) {
+            lock_guard<mutex> guard(lock);
+            free.push_back(i);
+        }
+
+        void close() {
+            {
+                lock_guard<mutex> guard(lock);
+                closed = true;
+            }
+            hasFilled.notify_one();
+        }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr<<"usage: ./build/main out.vdv [-seconds n]"<<endl;
+        return 1;
+    }
+    double seconds = 0;
+    for (int i = 2; i + 1 < argc; i++) {
+        if (string(argv[i]) == "-seconds") seconds = atof(argv[i+1]);
+    }
+
+    //stay off the driver's cores and behind the app
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(recorderCpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        cerr << "sched_setaffinity failed: " << strerror(errno) << " (continuing)\n";
+    }
+    if (nice(10) == -1) {
+        perror("nice");
+    }
+
+    volatile ShmLayout* shmPointer = openShm("vdshm");
+    if (shmPointer == nullptr) return 1;
+
+    VdvWriter writer;
+    if (!writer.open(argv[1])) return 1;
+
+    signal(SIGINT, [](int) { stopRequested = 1; });
+    signal(SIGTERM, [](int) { stopRequested = 1; });
+
+    SnapshotPool pool;
+    thread writerThread([&]() {
+        int i;
+        while ((i = pool.next()) >= 0) {
+            writer.addFrame(pool.at(i).slices.data(), pool.at(i).time);
+            pool.release(i);
+        }
+        writer.close();
+    });
+
+    Compositor compositor(false);
+    int64_t start = chrono::steady_clock::now().time_since_epoch().count();
+    size_t frames = 0;
+    size_t dropped = 0;
+    uint32_t seen = loadNotify(shmPointer->notify.revolution);
+    printf("recording to %s, ctrl-c to stop\n", argv[1]);
+    while (!stopRequested) {
+        if (!waitNotify(shmPointer->notify.revolution, seen, 100000000)) continue;
+        seen = loadNotify(shmPointer->notify.revolution);
+        int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+        if (seconds > 0 && now - start > seconds * 1e9) break;
+
+        int i = pool.take();
+        if (i < 0) {
+            dropped++;
+            continue;
+        }
+        //the frame the driver picks for this revolution: a shown queued frame or the live data, with the layers on top.
+        //the driver may switch frames right after the notify, a queued frame is only freed (and refilled) once showing moved on
+        uint32_t showing;
+        do {
+            showing = shmPointer->frameQueue.showing;
+            volatile ShmVoxelFrame& base = showing == FRAME_QUEUE_LIVE ? shmPointer->data : const_cast<ShmFrameQueue&>(shmPointer->frameQueue).frames[showing].data;
+            const ShmVoxelSlice* shown = compositor.compose(shmPointer, const_cast<ShmVoxelFrame&>(base), false);
+            copy(shown, shown + 2000, pool.at(i).slices.begin());
+        } while (showing != shmPointer->frameQueue.showing);
+        pool.at(i).time = now;
+        pool.submit(i);
+        frames++;
+    }
+
+    pool.close();
+    writerThread.join();
+    printf("recorded %zu frames (%zu dropped), %.1f MB\n", frames, dropped, writer.bytesWritten() / 1e6);
+}
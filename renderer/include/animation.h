@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#include "types.h"
+#include "linalg.h"
+
+using namespace std;
+
+//keyframe animation of an object's transformation and color. a Scene samples every animation once per render,
+//at the time the frame will be shown, and only objects whose sampled values changed are redrawn
+enum class Easing {
+    LINEAR,
+    SMOOTH, // eases in and out of the keys (smoothstep)
+    STEP,   // holds the value until the next key
+};
+
+template<typename T>
+struct Keyframe {
+    float time; // seconds from the start of the animation
+    T value;
+    Easing easing = Easing::LINEAR; // of the way from this key to the next
+};
+
+inline Vec3<float> lerp(const Vec3<float>& a, const Vec3<float>& b, float t) {
+    return a + (b - a) * t;
+}
+
+inline Color lerp(const Color& a, const Color& b, float t) {
+    return { a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t, a.b + (b.b - a.b) * t };
+}
+
+//keys in time order. before the first key the track holds its value, after the last one too
+template<typename T>
+struct Track {
+    vector<Keyframe<T>> keys;
+
+    bool empty() const { return keys.empty(); }
+    float duration() const { return keys.empty() ? 0 : keys.back().time; }
+
+    T sample(double time) const {
+        auto next = upper_bound(keys.begin(), keys.end(), time, [](double t, const Keyframe<T>& key) { return t < key.time; });
+        if (next == keys.begin()) return keys.front().value;
+        if (next == keys.end()) return keys.back().value;
+        const Keyframe<T>& key = *(next - 1);
+        float t = (time - key.time) / (next->time - key.time);
+        switch (key.easing) {
+            case Easing::LINEAR: break;
+            case Easing::SMOOTH: t = t * t * (3 - 2 * t); break;
+            case Easing::STEP: return key.value;
+        }
+        return lerp(key.value, next->value, t);
+    }
+};
+
+//empty tracks leave that part of the object alone, so an animation can move an object the app colors itself
+struct Animation {
+    Track<Vec3<float>> translation;
+    Track<Vec3<float>> rotation;
+    Track<Vec3<float>> scale;
+    Track<Color> color;
+    bool loop = false; // starts over after the last key of the longest track
+
+    float duration() const {
+        return max({ translation.duration(), rotation.duration(), scale.duration(), color.duration() });
+    }
+};
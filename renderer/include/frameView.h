@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "shm.h"
+
+using namespace std;
+
+//the display as seen from outside: maps the bytes of a frame back to the update pattern positions they light.
+//used offline on shm snapshots, .vdv videos and headless renders, e.g. to check that a change to the renderer
+//still lights exactly the same voxels
+struct LitVoxel {
+    Vec3<float> pos;
+    uint16_t sliceIndex;
+    uint8_t dataIndex; // into ShmVoxelSlice::data
+    uint8_t color; // Color1b bits
+};
+
+enum class ProjectionAxis {
+    TOP,   // looking down the rotation axis, x right, y up
+    FRONT, // from -y, x right, z up
+    SIDE,  // from +x, y right, z up
+};
+
+struct ProjectionImage {
+    int width;
+    int height;
+    vector<uint8_t> rgb; // rows top to bottom, unlit pixels are black
+};
+
+class FrameView {
+    public:
+        explicit FrameView(const UpdatePattern& pattern);
+
+        //lit voxels in slice and data order, bytes the pattern has no position for are counted in unplaced
+        vector<LitVoxel> litVoxels(const ShmVoxelSlice* frame, size_t* unplaced = nullptr) const;
+        //orthographic view, the voxel nearest to the viewer wins. the image covers the whole pattern, so
+        //images of different frames line up
+        ProjectionImage project(const vector<LitVoxel>& voxels, ProjectionAxis axis, float pixelsPerUnit = 4) const;
+
+    private:
+        vector<Vec3<float>> positions; // by sliceIndex * 256 + dataIndex
+        vector<bool> placed;
+        vector<array<uint8_t, 2>> columns; // pattern column of each slice, per display
+        Vec3<float> boundsMin;
+        Vec3<float> boundsMax;
+};
+
+//binary little endian ply with x y z, red green blue and the slice and data index of every voxel
+void writeLitVoxels(const vector<LitVoxel>& voxels, const string& path);
+bool readLitVoxels(const string& path, vector<LitVoxel>& voxels); // only reads files from writeLitVoxels
+
+void writePpm(const ProjectionImage& image, const string& path);
+
+struct VoxelDiff {
+    size_t missing = 0; // lit in the expected frame only
+    size_t extra = 0; // lit in the actual frame only
+    size_t recolored = 0;
+};
+
+VoxelDiff diffLitVoxels(const vector<LitVoxel>& expected, const vector<LitVoxel>& actual);
@@ -2,16 +2,121 @@
 
 #include<array>
 #include<vector>
+#include<span>
+#include<tuple>
 #include "types.h"
 
 using namespace std;
 
-inline int packIndex(int ix, int iy, int iz);
+// inclusive range of cell coordinates, already clamped to the grid
+struct CellRange {
+    int minIx, minIy, minIz;
+    int maxIx, maxIy, maxIz;
+};
 
-inline array<int, 3> unpackIndex(int packed);
+// update pattern points sorted by cell, cell i owns points[cellStarts[i]] up to points[cellStarts[i+1]]
+struct SpatialGrid {
+    GridParams params;
+    UpdatePattern points;
+    vector<uint32_t> cellStarts;
 
-int calculateIndex(const GridParams& params, const Vec3<float>& ptCoords);
+    inline int cellsPerAxis() const { return params.gridSize + 1; } // points on the max face land in cell gridSize
 
-vector<int> calculateIndicesFromBB(const GridParams& params, const Vec3<float>& min, const Vec3<float>& max, float padding = 0.);
+    inline int flatIndex(int ix, int iy, int iz) const {
+        int n = cellsPerAxis();
+        return (ix * n + iy) * n + iz;
+    }
 
-tuple<unordered_map<int, UpdatePattern>, GridParams> buildGrid(const UpdatePattern& points, int ptsPerCell);
+    inline span<const UpdatePatternPoint> cell(int ix, int iy, int iz) const {
+        int index = flatIndex(ix, iy, iz);
+        return { points.data() + cellStarts[index], points.data() + cellStarts[index + 1] };
+    }
+
+    // calls f(ix, iy, iz, points) for every non empty cell in range, allocates nothing
+    template<typename F>
+    inline void forEachCell(const CellRange& range, F&& f) const {
+        for (int ix = range.minIx; ix <= range.maxIx; ix++) {
+            for (int iy = range.minIy; iy <= range.maxIy; iy++) {
+                for (int iz = range.minIz; iz <= range.maxIz; iz++) {
+                    auto cellPoints = cell(ix, iy, iz);
+                    if (not cellPoints.empty()) f(ix, iy, iz, cellPoints);
+                }
+            }
+        }
+    }
+};
+
+array<int, 3> calculateCellCoords(const GridParams& params, const Vec3<float>& ptCoords);
+
+CellRange calculateCellRange(const GridParams& params, const Vec3<float>& minV, const Vec3<float>& maxV, float padding = 0.);
+
+enum class CellCoverage {
+    OUTSIDE, // no point of the cell can be part of the primitive
+    PARTIAL, // points have to be tested one by one
+    INSIDE   // every point of the cell is part of the primitive
+};
+
+// bounds of a cell, padded slightly so every point sorted into it by calculateCellCoords lies inside
+tuple<Vec3<float>, Vec3<float>> calculateCellBounds(const GridParams& params, int ix, int iy, int iz);
+
+SpatialGrid buildGrid(const UpdatePattern& points, int ptsPerCell);
+
+// grid in (radius, angle, z) around the rotation axis. The voxels lie on radial columns, so radial cells are
+// split at quantiles of the point radii and every cell holds about the same number of points
+struct CylindricalGridParams {
+    vector<float> radiusEdges; // nRadii + 1 edges, first is 0
+    int nRadii;
+    int nAngles;
+    float angleStep;
+    float zMin;
+    float zStep;
+    int nZ;
+
+    int radiusCell(float radius) const;
+    int angleCell(float angle) const; // angle in radians, any range
+    int zCell(float z) const;
+};
+
+// angle cells wrap around, the range covers angleCount cells starting at minIa
+struct CylindricalCellRange {
+    int minIr, maxIr;
+    int minIa, angleCount;
+    int minIz, maxIz;
+};
+
+struct CylindricalGrid {
+    CylindricalGridParams params;
+    UpdatePattern points;
+    vector<uint32_t> cellStarts;
+
+    inline int flatIndex(int ir, int ia, int iz) const {
+        return (ir * params.nAngles + ia) * params.nZ + iz;
+    }
+
+    inline span<const UpdatePatternPoint> cell(int ir, int ia, int iz) const {
+        int index = flatIndex(ir, ia, iz);
+        return { points.data() + cellStarts[index], points.data() + cellStarts[index + 1] };
+    }
+
+    // calls f(ir, ia, iz, points) for every non empty cell in range, allocates nothing
+    template<typename F>
+    inline void forEachCell(const CylindricalCellRange& range, F&& f) const {
+        for (int ir = range.minIr; ir <= range.maxIr; ir++) {
+            for (int k = 0; k < range.angleCount; k++) {
+                int ia = (range.minIa + k) % params.nAngles;
+                for (int iz = range.minIz; iz <= range.maxIz; iz++) {
+                    auto cellPoints = cell(ir, ia, iz);
+                    if (not cellPoints.empty()) f(ir, ia, iz, cellPoints);
+                }
+            }
+        }
+    }
+};
+
+CylindricalCellRange calculateCellRange(const CylindricalGridParams& params, const Vec3<float>& minV, const Vec3<float>& maxV, float padding = 0.);
+CylindricalCellRange calculateCellRange(const CylindricalGridParams& params, const Vec3<float>& center, float radius);
+
+// axis aligned bounds of an annular sector cell, padded like the cubic ones
+tuple<Vec3<float>, Vec3<float>> calculateCellBounds(const CylindricalGridParams& params, int ir, int ia, int iz);
+
+CylindricalGrid buildCylindricalGrid(const UpdatePattern& points, int ptsPerCell);
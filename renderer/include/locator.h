@@ -0,0 +1,66 @@
+#pragma once
+
+#include<vector>
+#include<array>
+#include<cmath>
+#include<algorithm>
+#include "types.h"
+#include "slice.h"
+
+using namespace std;
+
+//geometry of the update pattern generator
+const float PITCH = 2.5;
+const float PANEL_2_OFFSET = 15 / PITCH; // display 2 columns lie on a line this far from the axis
+
+// range of slices [first, last], last can go past the slice count and wraps around
+struct SliceWindow {
+    int first;
+    int last;
+};
+
+// inverse of the update pattern: maps a world position straight to the slices whose lit columns pass near it.
+// a display 1 column of slice s lies on the line through the axis at angle 2*pi*s/nSlices,
+// a display 2 column on the parallel line PANEL_2_OFFSET away, so the slices follow from the angle of the position
+struct VoxelLocator {
+    int nSlices = 0;
+    float sliceAngle = 0;
+    vector<uint32_t> sliceStarts;
+    vector<SliceColumn> columns; // lit columns by slice
+
+    // slices where the columns of a display pass within radius of (x, y), returns the number of windows
+    int sliceWindows(float x, float y, float radius, bool isDisplay1, array<SliceWindow, 2>& windows) const;
+
+    // the voxel closest to pos, false if there is none within maxDistance
+    bool nearestVoxel(const Vec3<float>& pos, float maxDistance, PointDisplayParams& params, Vec3<float>& voxelPos) const;
+
+    // calls f(column, row) for every voxel within radius of center
+    template<typename F>
+    inline void forEachVoxel(const Vec3<float>& center, float radius, F&& f) const {
+        if (nSlices == 0 || radius < 0) return;
+        float radius2 = radius * radius;
+        for (bool isDisplay1 : { true, false }) {
+            array<SliceWindow, 2> windows;
+            int nWindows = sliceWindows(center.x, center.y, radius, isDisplay1, windows);
+            for (int w = 0; w < nWindows; w++) {
+                for (int s = windows[w].first; s <= windows[w].last; s++) {
+                    int slice = s % nSlices;
+                    for (uint32_t i = sliceStarts[slice]; i < sliceStarts[slice + 1]; i++) {
+                        const SliceColumn& column = columns[i];
+                        if (column.base.isDisplay1 != isDisplay1) continue;
+                        float dx = column.x - center.x;
+                        float dy = column.y - center.y;
+                        float h2 = radius2 - dx * dx - dy * dy;
+                        if (h2 < 0) continue;
+                        float h = sqrt(h2);
+                        int firstRow = (int) clamp(ceil(center.z - h - column.z0), 0.f, (float) columnHeight);
+                        int lastRow = (int) clamp(floor(center.z + h - column.z0), -1.f, (float) columnHeight - 1);
+                        for (int row = firstRow; row <= lastRow; row++) f(column, row);
+                    }
+                }
+            }
+        }
+    }
+};
+
+VoxelLocator buildVoxelLocator(const UpdatePattern& points);
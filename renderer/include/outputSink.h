@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <string>
+
+#include "types.h"
+#include "shm.h"
+#include "vdv.h"
+
+using namespace std;
+
+//where a Scene's renders go. every render hands over the points that changed since the last one
+class OutputSink {
+    public:
+        virtual ~OutputSink() = default;
+        virtual void write(const Render& changes) = 0;
+        virtual void writeAt(const Render& changes, int64_t /*presentTime*/) { write(changes); } // sinks without a frame queue write it now
+        virtual void wipe() = 0;
+        virtual ShmLayout* shm() { return nullptr; } // input and rotor timing, only sinks on "vdshm" have them
+};
+
+//the display: the main frame in "vdshm", or a layer the driver merges with it
+class ShmSink : public OutputSink {
+    public:
+        ShmSink(); // the main frame, wiped
+        ShmSink(int layerZOrder, ShmBlendMode layerBlend);
+
+        void write(const Render& changes) override;
+        void writeAt(const Render& changes, int64_t presentTime) override;
+        void wipe() override;
+        ShmLayout* shm() override { return shmPointer; }
+        void setFrameFormat(ShmFrameFormat format); // PACKED_GPIO also keeps driver-ready gpio words in shm
+    private:
+        ShmLayout* shmPointer = nullptr;
+        int layer = -1; // index into shm layers, -1 for the main frame
+        vector<ShmVoxelSlice> queuedState = {}; // whole frame the queued renders build on, empty until writeAt is used
+
+        ShmVoxelFrame& targetFrame();
+        ShmDirtySlices& targetDirty();
+};
+
+//keeps the frame in memory, for tests and for checking renders on a machine without the display
+class FramebufferSink : public OutputSink {
+    public:
+        vector<ShmVoxelSlice> frame = vector<ShmVoxelSlice>(2000);
+        ShmDirtySlices dirty = {}; // slices changed since the last clearDirty
+        size_t renders = 0;
+
+        void write(const Render& changes) override;
+        void wipe() override;
+        void clearDirty() { dirty = {}; }
+};
+
+//drops every render, what is left is the time spent drawing
+class NullSink : public OutputSink {
+    public:
+        size_t renders = 0;
+        size_t points = 0;
+
+        void write(const Render& changes) override {
+            renders++;
+            points += changes.size();
+        }
+        void wipe() override {}
+};
+
+//appends every render to a .vdv video, so heavy scenes can be rendered offline and played back with apps/player
+class VdvSink : public FramebufferSink {
+    public:
+        VdvSink(const string& path, uint32_t keyframeInterval = 48);
+
+        void write(const Render& changes) override; // stamped with the current time
+        void writeAt(const Render& changes, int64_t presentTime) override; // stamped with presentTime
+    private:
+        VdvWriter writer;
+};
@@ -2,11 +2,18 @@
 #include<vector>
 #include<unordered_map>
 #include <variant>
+#include <memory>
+#include <chrono>
 
 #include "types.h"
+#include "grid.h"
+#include "slice.h"
+#include "locator.h"
 #include "linalg.h"
 #include "dither.h"
 #include "shm.h"
+#include "outputSink.h"
+#include "animation.h"
 
 using namespace std;
 
@@ -70,6 +77,16 @@ struct TextGeometry {
     TextOrientation orientation = TextOrientation::POS_Y;
 };
 
+enum class SpatialIndexType {
+    CUBIC,       // cubic grid over the bounding box of the update pattern
+    CYLINDRICAL  // (radius, angle, z) grid matching the rotating columns
+};
+
+enum class DrawEngine {
+    POINT_TEST,  // tests the update pattern points found through the spatial index
+    SLICE_RASTER // intersects primitives with the lit columns of each slice and lights their rows directly
+};
+
 using Geometry = variant<ParticleGeometry, CapsuleGeometry, TriangleGeometry, SphereGeometry, CuboidGeometry, MeshGeometry, TextGeometry>;
 
 
@@ -78,6 +95,7 @@ using Geometry = variant<ParticleGeometry, CapsuleGeometry, TriangleGeometry, Sp
 class Object {
     public:
         bool toRerender = true;
+        Render drawnPoints = {}; // lit by its last draw, sent black when it is redrawn or removed
         ObjectId getId() const { return id; }
         const Geometry& getGeometry() const { return geometry; }
         const Transformation& getTransformation() const { return transformation; }
@@ -92,6 +110,12 @@ class Object {
         void scale(Vec3<float> newScale);
         void setPivot(Vec3<float> newPivot);
 
+        //an animation starting at startTime (steady_clock ns), 0 starts it at the next sample
+        void setAnimation(shared_ptr<const Animation> newAnimation, int64_t startTime = 0);
+        bool isAnimated() const { return animation != nullptr; }
+        //applies the animation's values at time, marks the object for rerender only if one of them changed
+        void sampleAnimation(int64_t time);
+
         Object(ObjectId initId, Geometry initGeometry, Color initColor, ClippingBehavior initClippingBehavior);
     private:
         const Geometry& transformGeometry();
@@ -100,17 +124,69 @@ class Object {
         Transformation transformation;
         ClippingBehavior clippingBehavior;
         Color color;
+        shared_ptr<const Animation> animation = nullptr; // dropped once a non looping animation has ended
+        int64_t animationStart = 0;
+};
+
+//counts and stage times of the last render or renderAt, apps on shm also publish them to ShmLayout::renderStats
+struct RenderStats {
+    size_t pointsTested = 0; // candidates the draws looked at: bucket points, or columns with SLICE_RASTER
+    size_t pointsEmitted = 0; // lit by the redrawn objects
+    size_t pointsErased = 0; // of redrawn and removed objects, sent black
+    size_t objectsRedrawn = 0;
+    //ns per stage. cells is the draw time outside the inclusion tests, SLICE_RASTER and particles only have tests
+    int64_t transformNs = 0;
+    int64_t cellsNs = 0;
+    int64_t testsNs = 0;
+    int64_t ditherNs = 0;
+    int64_t diffNs = 0; // finding the points to erase
+    int64_t writeNs = 0; // handing the render to the sink, for renderAt including the wait for a queue slot
+    int64_t totalNs = 0;
+};
+
+inline int64_t steadyNs() {
+    return chrono::steady_clock::now().time_since_epoch().count();
+}
+
+//adds the time until the end of its scope to ns
+struct ScopedTimer {
+    int64_t& ns;
+    int64_t start = steadyNs();
+    ScopedTimer(int64_t& ns_) : ns(ns_) {}
+    ~ScopedTimer() { ns += steadyNs() - start; }
+};
+
+//what a Scene draws on and where its renders go. the defaults are the display: the generated pattern and shm
+struct SceneConfig {
+    string updatePatternPath = "../../update_pattern_gen/output.txt";
+    const UpdatePattern* updatePattern = nullptr; // used instead of updatePatternPath when set
+    shared_ptr<OutputSink> sink = nullptr; // a wiped ShmSink when null
 };
 
 class Scene {
     public: 
-        GridParams params;
-        std::unordered_map<int, UpdatePattern> mapping;
+        SpatialGrid grid;
+        CylindricalGrid cylindricalGrid; // built on first use
+        ColumnGrid columnGrid; // built on first use
+        VoxelLocator voxelLocator;
         ObjectId createObject(const Geometry& initGeometry, const Color& initColor, ClippingBehavior initClippingBehavior=ADD);
         Object& getObject(ObjectId);
         void render(bool writeToFile = false);
+        //queues the frame to be shown from the first revolution starting at presentTime (steady_clock ns),
+        //blocks while all FRAME_QUEUE_LENGTH slots are taken
+        void renderAt(int64_t presentTime);
+        int64_t revolutionTime(int revolutionsAhead = 1); // predicted start of an upcoming revolution, for renderAt
+        const RenderStats& getRenderStats() const { return stats; }
 
         KeyboardState getPressedKeys();
+        vector<KeyEvent> pollKeyEvents(); // presses since the last call, each one exactly once and in order
+        //block instead of polling, false on timeout. timeoutMs < 0 waits forever
+        bool waitForKeys(int timeoutMs = -1); // returns once the keys changed since the last getPressedKeys or pollKeyEvents
+        bool waitForRevolution(int timeoutMs = 1000); // returns once the next revolution since the last call started
+
+        void setSpatialIndex(SpatialIndexType type);
+        void setDrawEngine(DrawEngine engine);
+        void setFrameFormat(ShmFrameFormat format); // PACKED_GPIO also keeps driver-ready gpio words in shm
 
         void setObjectGeometry(ObjectId id, Geometry newGeometry);
         void setObjectColor(ObjectId id, Color newColor);
@@ -118,54 +194,86 @@ class Scene {
         void setObjectRotation(ObjectId id, Vec3<float> newRotation);
         void setObjectScale(ObjectId id, Vec3<float> newScale);
         void setObjectIntrinsicPivot(ObjectId id, Vec3<float> newPivot);
+        //plays an animation on the object, replacing its previous one. one Animation can be shared by many objects.
+        //render() samples it at the time of the call, renderAt() at presentTime, so a loop of
+        //waitForRevolution() and render() moves the object every revolution without any further calls
+        void animateObject(ObjectId id, shared_ptr<const Animation> animation, int64_t startTime = 0);
+        void stopAnimation(ObjectId id); // the object keeps the values it has now
+        bool isAnimating() const; // false once every animation has ended, looping ones never do
 
         void wipe();
         void removeObject(ObjectId objectId);
         
     Scene();
+    //headless with a FramebufferSink, NullSink or VdvSink: input and revolution calls act as if nothing is pressed and the rotor runs at 24 Hz
+    explicit Scene(const SceneConfig& config);
+    //renders into a layer of its own that the driver merges with the main app's frame, e.g. for an overlay.
+    //layers are always live, renderAt and PACKED_GPIO only apply to the main app
+    Scene(int layerZOrder, ShmBlendMode layerBlend = BLEND_OVER);
     private:
         ObjectId lastId = 0;
         vector<Object> objects = {};
-        vector<ObjectId> toRemove = {};
+        Render toErase = {}; // points of removed objects, sent black by the next render
         unordered_map<ObjectId, uint32_t> idToIndex;
         ObjectId nextId();
 
-        ShmLayout* shmPointer;
+        shared_ptr<OutputSink> sink;
+        ShmLayout* shmPointer = nullptr; // the sink's shm, null when headless
+        uint32_t seenKeys = 0; // notify counts at the last getPressedKeys and waitForRevolution
+        uint32_t seenRevolution = 0;
+        uint32_t keyEventCursor = 0; // our read position in shm keyEvents
+
+        SpatialIndexType spatialIndex = SpatialIndexType::CUBIC;
+        //calls f(points, cellBounds) for cells of the selected index overlapping the box, cellBounds() returns the cell's bounds
+        template<typename F>
+        void forEachCell(const Vec3<float>& minV, const Vec3<float>& maxV, float padding, F&& f) const;
+
+        DrawEngine drawEngine = DrawEngine::POINT_TEST;
+        //lights the rows given by columnSpan(x, y) for every lit column inside the xy box
+        template<typename F>
+        void rasterize(
+            const Vec3<float>& minV, const Vec3<float>& maxV, float padding,
+            ClippingBehavior clippingBehavior, ObjectId objectId, Render& render,
+            F&& columnSpan
+        ) const;
 
         Render lastRender = {};
-        
+        mutable RenderStats stats; // counted by the const cell walks too
+        uint64_t renderCount = 0;
+        void publishStats(); // to shm renderStats, for the control panel
+        void sampleAnimations(int64_t time); // all animated objects in one pass, before the draws
+        //scratch buffers reused by every render, they keep their capacity so steady state rendering doesnt allocate
+        Render renderBuffer = {};
+        Render pointsToAdd = {};
+
         void draw(Object& object, Render& render);
+        void drawChanges(); // draws removed and changed objects into lastRender
         void drawParticle(
             const ParticleGeometry& geometry,
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId,
             Render& render
         );
         void drawCapsule(
             const CapsuleGeometry& geometry,
-            const Color& color, 
             ClippingBehavior clippingBehavior,
             ObjectId objectId, 
             Render& render
         );
         void drawTriangle(
             const TriangleGeometry& geometry, 
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId, 
             Render& render
         );
         void drawSphere(
             const SphereGeometry& geometry, 
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId,
             Render& render
         );
         void drawCuboid(
             const CuboidGeometry& geometry,
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId, 
             Render& render
@@ -173,14 +281,12 @@ class Scene {
         void drawMesh(
             const MeshGeometry& geometry,
             const Transformation& transformation,
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId, 
             Render& render
         );
         void drawText(
             const TextGeometry& geometry,
-            const Color& color,
             ClippingBehavior clippingBehavior,
             ObjectId objectId, 
             Render& render
@@ -0,0 +1,63 @@
+#pragma once
+
+#include<vector>
+#include<span>
+#include<cmath>
+#include<algorithm>
+#include "types.h"
+
+using namespace std;
+
+const int columnHeight = 64;
+
+// one lit column of a slice: the 64 rows of a panel side stacked along z. Row r sits at z0 + r
+struct SliceColumn {
+    float x;
+    float y;
+    float z0;
+    PointDisplayParams base; // display params of row 0
+    Vec3<float> normal;
+};
+
+// part of a column covered by a primitive, rows strictly inside (lo, hi) and not strictly inside the hole are lit
+struct ColumnSpan {
+    float lo;
+    float hi;
+    float holeLo = 0;
+    float holeHi = 0;
+};
+
+// lit columns of every slice bucketed in a uniform xy grid, so a primitive only visits the columns below it
+struct ColumnGrid {
+    float minX, minY;
+    float cellSize;
+    int nx, ny;
+    vector<SliceColumn> columns;
+    vector<uint32_t> cellStarts;
+
+    template<typename F>
+    inline void forEachColumn(float x0, float y0, float x1, float y1, F&& f) const {
+        auto cellIndex = [&](float v, float minV, int n) { return (int) clamp(floor((v - minV) / cellSize), -1.f, (float) n); };
+        int ix0 = max(cellIndex(x0, minX, nx), 0);
+        int iy0 = max(cellIndex(y0, minY, ny), 0);
+        int ix1 = min(cellIndex(x1, minX, nx), nx - 1);
+        int iy1 = min(cellIndex(y1, minY, ny), ny - 1);
+        for (int ix = ix0; ix <= ix1; ix++) {
+            for (int iy = iy0; iy <= iy1; iy++) {
+                int index = ix * ny + iy;
+                for (uint32_t i = cellStarts[index]; i < cellStarts[index + 1]; i++) {
+                    const SliceColumn& column = columns[i];
+                    if (column.x >= x0 && column.x <= x1 && column.y >= y0 && column.y <= y1) f(column);
+                }
+            }
+        }
+    }
+};
+
+ColumnGrid buildColumnGrid(const UpdatePattern& points, float cellSize = 2);
+
+// intersections of a vertical line at (x, y) with primitives, empty spans have lo >= hi
+ColumnSpan sphereColumnSpan(float x, float y, const Vec3<float>& center, float radius2, float innerRadius2);
+ColumnSpan boxColumnSpan(float x, float y, const Vec3<float>& minV, const Vec3<float>& maxV, float thickness);
+ColumnSpan capsuleColumnSpan(float x, float y, const Vec3<float>& start, const Vec3<float>& end, float radius);
+ColumnSpan triangleColumnSpan(float x, float y, const Vec3<float>& v1, const Vec3<float>& v2, const Vec3<float>& v3, float thickness);
@@ -38,6 +38,8 @@ struct Color {
     float g;
     float b;
 
+    bool operator==(const Color&) const = default; // exact, not through Color1b
+
     inline operator Color1b() const {
         return {
             r>0.5,
@@ -116,4 +118,9 @@ struct Mesh {
     void center(float padding = 0);
 };
 
-using KeyboardState = std::array<char, 8>; //doesnt include timestamp!
\ No newline at end of file
+using KeyboardState = std::array<char, 8>; //doesnt include timestamp!
+
+struct KeyEvent {
+    char key; // lowercase like getPressedKeys
+    int64_t time; // steady_clock ns when the control panel received the press
+};
\ No newline at end of file
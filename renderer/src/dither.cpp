@@ -2,7 +2,9 @@
 #include<assert.h>
 #include<cmath>
 #include<cstdio>
+#include<string>
 #include "types.h"
+#include "log.h"
 
 using namespace std;
 //uses the algorithm for generation bayer matrices from wikipedia generalized to 3d
@@ -117,15 +119,18 @@ Mat3d<float> generateBayer(int n) {
     for (int i = 2; i <= n; ++i) {
         bayer = kronecker3d(ones2, bayer * 8) + kronecker3d(bayer2x2, generate_ones(pow(2, i-1)));
     }
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
     for (int x = 0; x < bayer.size(); ++x){
         for (int y = 0; y < bayer[0].size(); ++y){
+            string row;
             for (int z = 0; z < bayer[0][0].size(); ++z){
-                printf("%d, ", bayer[x][y][z]);
+                row += to_string(bayer[x][y][z]) + ", ";
             }
-            printf("\n");
+            LOG_DEBUG("%s", row.c_str());
         }
-        printf("------\n");
+        LOG_DEBUG("------");
     }
+#endif
     Mat3d<float> normalized;
     normalized.assign(bayer.size(), vector<vector<float>>(bayer[0].size(),vector<float>(bayer[0][0].size())));
     for (int x = 0; x < bayer.size(); ++x){
@@ -140,7 +145,7 @@ Mat3d<float> generateBayer(int n) {
 Mat3d<float> bayer = generateBayer(N);
 
 Color1b dither(Color color, float ditherRank) {
-    printf("rank: %f color: %f\n", ditherRank, color.r);
+    LOG_DEBUG("rank: %f color: %f", ditherRank, color.r);
     bool r = powf(color.r, 1.5) > ditherRank;
     //bool g = powf(color.g, 1.5) > fmod(ditherRank + 0.333 ,1.);
     // bool r = false;
@@ -1,84 +1,199 @@
 #include "renderer.h"
 #include "types.h"
 #include "grid.h"
+#include "log.h"
+#include "trace.h"
 #include <cstdio>
 #include <iostream>
 #include <algorithm>
 
+//whole-cell tests, cells are classified by their bounds before testing any points
+static inline bool isBoxInside(const Vec3<float>& innerMin, const Vec3<float>& innerMax, const Vec3<float>& outerMin, const Vec3<float>& outerMax) {
+    return outerMin.x < innerMin.x && outerMin.y < innerMin.y && outerMin.z < innerMin.z &&
+           outerMax.x > innerMax.x && outerMax.y > innerMax.y && outerMax.z > innerMax.z;
+}
+
+static inline bool isBoxDisjoint(const Vec3<float>& min1, const Vec3<float>& max1, const Vec3<float>& min2, const Vec3<float>& max2) {
+    return max1.x <= min2.x || max1.y <= min2.y || max1.z <= min2.z ||
+           min1.x >= max2.x || min1.y >= max2.y || min1.z >= max2.z;
+}
+
+static CellCoverage classifyCellCuboid(
+    const Vec3<float>& cellMin, const Vec3<float>& cellMax,
+    const Vec3<float>& minV, const Vec3<float>& maxV, float thickness
+) {
+    Vec3<float> innerMin = minV + thickness;
+    Vec3<float> innerMax = maxV - thickness;
+    if (isBoxDisjoint(cellMin, cellMax, minV, maxV)) return CellCoverage::OUTSIDE;
+    if (thickness > 0 && isBoxInside(cellMin, cellMax, innerMin, innerMax)) return CellCoverage::OUTSIDE;
+
+    if (isBoxInside(cellMin, cellMax, minV, maxV) &&
+        (thickness <= 0 || isBoxDisjoint(cellMin, cellMax, innerMin, innerMax))) return CellCoverage::INSIDE;
+    return CellCoverage::PARTIAL;
+}
+
+static CellCoverage classifyCellSphere(
+    const Vec3<float>& cellMin, const Vec3<float>& cellMax,
+    const Vec3<float>& pos, float radius2, float innerRadius2
+) {
+    Vec3<float> nearest = {
+        clamp(pos.x, cellMin.x, cellMax.x),
+        clamp(pos.y, cellMin.y, cellMax.y),
+        clamp(pos.z, cellMin.z, cellMax.z)
+    };
+    Vec3<float> farthest = {
+        (pos.x - cellMin.x > cellMax.x - pos.x) ? cellMin.x : cellMax.x,
+        (pos.y - cellMin.y > cellMax.y - pos.y) ? cellMin.y : cellMax.y,
+        (pos.z - cellMin.z > cellMax.z - pos.z) ? cellMin.z : cellMax.z
+    };
+    float minD2 = dist2(nearest, pos);
+    float maxD2 = dist2(farthest, pos);
+
+    if (minD2 >= radius2 || maxD2 < innerRadius2) return CellCoverage::OUTSIDE;
+    if (maxD2 < radius2 && minD2 >= innerRadius2) return CellCoverage::INSIDE;
+    return CellCoverage::PARTIAL;
+}
+
+template<typename F>
+void Scene::forEachCell(const Vec3<float>& minV, const Vec3<float>& maxV, float padding, F&& f) const {
+    if (spatialIndex == SpatialIndexType::CYLINDRICAL) {
+        auto cellRange = calculateCellRange(cylindricalGrid.params, minV, maxV, padding);
+        cylindricalGrid.forEachCell(cellRange, [&](int ir, int ia, int iz, span<const UpdatePatternPoint> bucket) {
+            stats.pointsTested += bucket.size();
+            ScopedTimer timer(stats.testsNs);
+            f(bucket, [&]() { return calculateCellBounds(cylindricalGrid.params, ir, ia, iz); });
+        });
+    } else {
+        auto cellRange = calculateCellRange(grid.params, minV, maxV, padding);
+        grid.forEachCell(cellRange, [&](int ix, int iy, int iz, span<const UpdatePatternPoint> bucket) {
+            stats.pointsTested += bucket.size();
+            ScopedTimer timer(stats.testsNs);
+            f(bucket, [&]() { return calculateCellBounds(grid.params, ix, iy, iz); });
+        });
+    }
+}
+
+template<typename F>
+void Scene::rasterize(
+    const Vec3<float>& minV, const Vec3<float>& maxV, float padding,
+    ClippingBehavior clippingBehavior, ObjectId objectId, Render& render,
+    F&& columnSpan
+) const {
+    ScopedTimer timer(stats.testsNs); // the column walk and the span tests are one loop
+    columnGrid.forEachColumn(minV.x - padding, minV.y - padding, maxV.x + padding, maxV.y + padding, [&](const SliceColumn& column) {
+        stats.pointsTested++;
+        ColumnSpan span = columnSpan(column.x, column.y);
+        if (span.lo >= span.hi) return;
+
+        //rows strictly inside (lo, hi), clamped as floats first since spans can be unbounded
+        auto firstRowAbove = [&](float z) { return (int) clamp(floor(z - column.z0) + 1, 0.f, (float) columnHeight); };
+        auto lastRowBelow = [&](float z) { return (int) clamp(ceil(z - column.z0) - 1, -1.f, (float) columnHeight - 1); };
+        int firstRow = firstRowAbove(span.lo);
+        int lastRow = lastRowBelow(span.hi);
+        int holeFirst = columnHeight, holeLast = -1;
+        if (span.holeLo < span.holeHi) {
+            holeFirst = firstRowAbove(span.holeLo);
+            holeLast = lastRowBelow(span.holeHi);
+        }
+
+        for (int row = firstRow; row <= lastRow; row++) {
+            if (row >= holeFirst && row <= holeLast) {
+                row = holeLast;
+                continue;
+            }
+            Vec3<float> pos = { column.x, column.y, column.z0 + row };
+            PointDisplayParams pointDisplayParams = column.base;
+            pointDisplayParams.rowIndex = row;
+            render.push_back({ objectId, pointDisplayParams, pos, column.normal, {}, clippingBehavior });
+        }
+    });
+}
+
 void Scene::draw(Object& object, Render& render) {
+    static const char* geometryNames[] = { "particle", "capsule", "triangle", "sphere", "cuboid", "mesh", "text" }; // in Geometry order
+    TraceSpan objectSpan(geometryNames[object.getGeometry().index()], "draw", "object", object.getId());
+    int64_t start = steadyNs();
     auto geometry = object.getTransformedGeometry();
+    stats.transformNs += steadyNs() - start;
     auto color = object.getColor();
     auto clippingBehavior = object.getClippingBehavior();
     auto objectId = object.getId();
 
     // printf("-drawing object with id %d\n", (int) objectId);
-    Render pointsToAdd = {};
+    pointsToAdd.clear();
+    int64_t testsBefore = stats.testsNs;
+    start = steadyNs();
     visit([&](auto&& arg)
     {
     using T = std::decay_t<decltype(arg)>;
     if constexpr (std::is_same_v<T, ParticleGeometry>)
-        drawParticle(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawParticle(arg, clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, CapsuleGeometry>)
-        drawCapsule(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawCapsule(arg, clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, TriangleGeometry>)
-        drawTriangle(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawTriangle(arg, clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, SphereGeometry>)
-        drawSphere(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawSphere(arg, clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, CuboidGeometry>)
-        drawCuboid(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawCuboid(arg, clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, MeshGeometry>)
-        drawMesh(arg, object.getTransformation(), color, clippingBehavior, objectId, pointsToAdd);
+        drawMesh(arg, object.getTransformation(), clippingBehavior, objectId, pointsToAdd);
 
     else if constexpr (std::is_same_v<T, TextGeometry>)
-        drawText(arg, color, clippingBehavior, objectId, pointsToAdd);
+        drawText(arg, clippingBehavior, objectId, pointsToAdd);
     
     else
         static_assert(false, "non-exhaustive visitor!");
     }, geometry);
+    stats.cellsNs += steadyNs() - start - (stats.testsNs - testsBefore);
 
-    //add negative points (remove ones from last render)
-    for (RenderedPoint& lastRenderPoint : lastRender) {
-        if (lastRenderPoint.objectId == objectId) {
-            lastRenderPoint.objectId = (ObjectId)-1; // uint32_t max
-            lastRenderPoint.color = BLACK;
-            render.push_back(lastRenderPoint);
-        }
+    //colors are dithered in one pass over the new points, so the draws only decide which points are lit
+    start = steadyNs();
+    for (RenderedPoint& point : pointsToAdd) {
+        point.color = dither(color, point.pos);
+    }
+    stats.ditherNs += steadyNs() - start;
+    stats.pointsEmitted += pointsToAdd.size();
+    stats.objectsRedrawn++;
+
+    //add negative points (remove the ones of the object's last draw, however many renders ago)
+    start = steadyNs();
+    for (RenderedPoint erased : object.drawnPoints) {
+        erased.objectId = (ObjectId)-1; // uint32_t max
+        erased.color = BLACK;
+        render.push_back(erased);
     }
+    stats.pointsErased += object.drawnPoints.size();
+    object.drawnPoints.assign(pointsToAdd.begin(), pointsToAdd.end());
+    stats.diffNs += steadyNs() - start;
     render.insert(render.end(), pointsToAdd.begin(), pointsToAdd.end());
+    objectSpan.argNames[1] = "points";
+    objectSpan.args[1] = pointsToAdd.size();
 }
 
 
-void Scene::drawParticle( //can have parts cut off, points sampled from 1 cell
+void Scene::drawParticle( //voxels found from the angle of the position, no bucket scan
     const ParticleGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
 ){
-    auto& pos = geometry.pos;    
-
-    int index = calculateIndex(params, pos);
-    auto it = mapping.find(index);
-    if (it == mapping.end()) return;
-    const UpdatePattern& bucket = it->second;
-
-    float radius2 = pow(geometry.radius, 2);
-
-    for (const UpdatePatternPoint& pt : bucket) {
-        Vec3 potentialPtCoords = pt.pos;
-        double d2 = dist2(pos, potentialPtCoords);
-        if (d2 <= radius2) render.push_back({objectId, pt.pointDisplayParams, pos, pt.normal, dither(color, potentialPtCoords), clippingBehavior});
-    }
+    ScopedTimer timer(stats.testsNs);
+    voxelLocator.forEachVoxel(geometry.pos, geometry.radius, [&](const SliceColumn& column, int row) {
+        Vec3<float> pos = { column.x, column.y, column.z0 + row };
+        PointDisplayParams pointDisplayParams = column.base;
+        pointDisplayParams.rowIndex = row;
+        render.push_back({ objectId, pointDisplayParams, pos, column.normal, {}, clippingBehavior });
+    });
 }
 
 void Scene::drawCapsule(
     const CapsuleGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
@@ -93,12 +208,14 @@ void Scene::drawCapsule(
 
     auto vec = end - start;
     auto [minV, maxV] = arrangeBoundingBox(start, end);
-    auto bucketIndices = calculateIndicesFromBB(params, minV, maxV, radius);
 
-    for (int bucketIndex : bucketIndices) {
-        auto it = mapping.find(bucketIndex);
-        if (it == mapping.end()) continue;
-        const UpdatePattern& bucket = it->second;
+    if (drawEngine == DrawEngine::SLICE_RASTER) {
+        rasterize(minV, maxV, radius, clippingBehavior, objectId, render, [&](float x, float y) {
+            return capsuleColumnSpan(x, y, start, end, radius);
+        });
+        return;
+    }
+    forEachCell(minV, maxV, radius, [&](span<const UpdatePatternPoint> bucket, auto /*cellBounds*/) {
         for (const UpdatePatternPoint& pt : bucket) {
             const Vec3<float>& ptCoords = pt.pos;
             auto v1 = ptCoords-start;
@@ -121,14 +238,13 @@ void Scene::drawCapsule(
                 d2 = magnitude_2(cross(vec, v1)) / length2;
             }
 
-            if (d2 < radius2 ) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, dither(color, ptCoords), clippingBehavior });
+            if (d2 < radius2 ) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, {}, clippingBehavior });
         }
-    }
+    });
 }
 
 void Scene::drawTriangle(
     const TriangleGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
@@ -149,7 +265,12 @@ void Scene::drawTriangle(
         max(max(v1.z, v2.z), v3.z),
     };
 
-    auto bucketIndices = calculateIndicesFromBB(params, minV, maxV, thickness);
+    if (drawEngine == DrawEngine::SLICE_RASTER) {
+        rasterize(minV, maxV, thickness, clippingBehavior, objectId, render, [&](float x, float y) {
+            return triangleColumnSpan(x, y, v1, v2, v3, thickness);
+        });
+        return;
+    }
 
     Vec3 v21 = v2 - v1;
     Vec3 v32 = v3 - v2;
@@ -168,11 +289,7 @@ void Scene::drawTriangle(
 
     float thickness2 = thickness * thickness;
 
-    for (int bucketIndex : bucketIndices) {
-        auto it = mapping.find(bucketIndex);
-        if (it == mapping.end()) continue;
-        const UpdatePattern& bucket = it->second;
-
+    forEachCell(minV, maxV, thickness, [&](span<const UpdatePatternPoint> bucket, auto /*cellBounds*/) {
         for (const UpdatePatternPoint& pt : bucket) {
             const auto& ptCoords = pt.pos;
 
@@ -180,25 +297,28 @@ void Scene::drawTriangle(
             Vec3 p2 = ptCoords - v2;
             Vec3 p3 = ptCoords - v3;
 
-            bool inside = (sgn(dot(c21, p1)) + sgn(dot(c21, p1)) + sgn(dot(c21, p1))) < 2.;
+            //projection lies inside the triangle when the point is on the same side of all three edges
+            int s1 = sgn(dot(c21, p1));
+            int s2 = sgn(dot(c32, p2));
+            int s3 = sgn(dot(c13, p3));
+            bool inside = (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
             float d2;
             if (inside) {
+                d2 = pow(dot(normal, p1), 2) /magNormal;
+            }
+            else {
                 d2 = min(min(
                     magnitude_2(v21 * clamp(dot(v21, p1) / magV21, (float)0., (float)1.) - p1),
                     magnitude_2(v32 * clamp(dot(v32, p2) / magV32, (float)0., (float)1.) - p2)),
                     magnitude_2(v13 * clamp(dot(v13, p3) / magV13, (float)0., (float)1.) - p3));
             }
-            else {
-                d2 = pow(dot(normal, p1), 2) /magNormal;
-            }
-            if (d2 < thickness2) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, dither(color, ptCoords), clippingBehavior });
+            if (d2 < thickness2) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, {}, clippingBehavior });
         }
-    }
+    });
 }
 
 void Scene::drawSphere (
     const SphereGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
@@ -207,54 +327,69 @@ void Scene::drawSphere (
     auto radius = geometry.radius;
     auto thickness = geometry.thickness;
 
-    printf("-sphere: pos coords: %f, %f, %f\n", pos.x, pos.y, pos.z);
-    printf("-radius: %f\n", radius);
-    printf("-params: %f %f %\n", params.boundingBoxMax.x, params.cellSizes.x, params.gridSize);
+    LOG_DEBUG("-sphere: pos coords: %f, %f, %f, radius: %f", pos.x, pos.y, pos.z, radius);
 
-    auto bucketIndices = calculateIndicesFromBB(params, pos, pos, radius);
 
     float radius2 = radius * radius;
+    float innerRadius2 = thickness > 0 ? 2 * radius * thickness - radius2 : -1; // magic math supr
 
-    printf("-got %d bucket indices", (int) bucketIndices.size());
+    if (drawEngine == DrawEngine::SLICE_RASTER) {
+        rasterize(pos, pos, radius, clippingBehavior, objectId, render, [&](float x, float y) {
+            return sphereColumnSpan(x, y, pos, radius2, innerRadius2);
+        });
+        return;
+    }
 
-    for (int bucketIndex : bucketIndices) {
-        auto it = mapping.find(bucketIndex);
-        if (it == mapping.end()) continue;
-        const UpdatePattern& bucket = it->second;
+    forEachCell(pos, pos, radius, [&](span<const UpdatePatternPoint> bucket, auto cellBounds) {
+        auto [cellMin, cellMax] = cellBounds();
+        CellCoverage coverage = classifyCellSphere(cellMin, cellMax, pos, radius2, innerRadius2);
+        if (coverage == CellCoverage::OUTSIDE) return;
+        if (coverage == CellCoverage::INSIDE) {
+            for (const UpdatePatternPoint& pt : bucket) {
+                render.push_back({ objectId, pt.pointDisplayParams, pt.pos, pt.normal, {}, clippingBehavior });
+            }
+            return;
+        }
 
         for (const UpdatePatternPoint& pt : bucket) {
             const auto& ptCoords = pt.pos;
             float d2 = dist2(ptCoords, pos);
             //printf("d2: %f, r2: %f\n");
-            if (thickness > 0 && d2 < (2 * radius * thickness - radius2)) continue; // magic math supr
-            if (d2 < radius2) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, dither(color, ptCoords), clippingBehavior });
+            if (d2 < innerRadius2) continue;
+            if (d2 < radius2) render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, {}, clippingBehavior });
         }
-    }
+    });
 }
 
 void Scene::drawCuboid(
     const CuboidGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
 ) {
-    cout<<"drawing cuboid"<<endl;
-    printf("wireframe: %d\n", geometry.isWireframe);
+    LOG_DEBUG("drawing cuboid, wireframe: %d", geometry.isWireframe);
     auto& v1 = geometry.v1;
     auto& v2 = geometry.v2;
     auto thickness = geometry.thickness;
     
     auto [minV, maxV] = arrangeBoundingBox(v1, v2);
-    printf("params: %f %f %d\n", params.boundingBoxMax.x, params.cellSizes.x, params.gridSize);
-
-    if (not geometry.isWireframe) {
-        auto bucketIndices = calculateIndicesFromBB(params, minV, maxV);
-        printf("got %d bucket indices\n", bucketIndices.size());
-        for (int bucketIndex : bucketIndices) {
-            auto it = mapping.find(bucketIndex);
-            if (it == mapping.end()) continue;
-            const UpdatePattern& bucket = it->second;
+
+    if (not geometry.isWireframe && drawEngine == DrawEngine::SLICE_RASTER) {
+        rasterize(minV, maxV, 0, clippingBehavior, objectId, render, [&](float x, float y) {
+            return boxColumnSpan(x, y, minV, maxV, thickness);
+        });
+    } else if (not geometry.isWireframe) {
+        forEachCell(minV, maxV, 0, [&](span<const UpdatePatternPoint> bucket, auto cellBounds) {
+            auto [cellMin, cellMax] = cellBounds();
+            CellCoverage coverage = classifyCellCuboid(cellMin, cellMax, minV, maxV, thickness);
+            if (coverage == CellCoverage::OUTSIDE) return;
+            if (coverage == CellCoverage::INSIDE) {
+                for (const UpdatePatternPoint& pt : bucket) {
+                    render.push_back({ objectId, pt.pointDisplayParams, pt.pos, pt.normal, {}, clippingBehavior });
+                }
+                return;
+            }
+
             for (const UpdatePatternPoint& pt : bucket) {
                 const auto& ptCoords = pt.pos;
                 if (thickness > 0 &&
@@ -271,10 +406,10 @@ void Scene::drawCuboid(
                     maxV.x > ptCoords.x &&
                     maxV.y > ptCoords.y &&
                     maxV.z > ptCoords.z){
-                    render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, dither(color, ptCoords), clippingBehavior });;
+                    render.push_back({ objectId, pt.pointDisplayParams, ptCoords, pt.normal, {}, clippingBehavior });;
                 }
             }
-        }
+        });
     } else {
         //draw only edges, not diagonals
         for (uint combinedCoord1 = 0; combinedCoord1 < 2*2*2; combinedCoord1++) {            
@@ -292,18 +427,16 @@ void Scene::drawCuboid(
                     (combinedCoord2 & 2) ? minV.y : maxV.y, 
                     (combinedCoord2 & 4) ? minV.z : maxV.z
                 }; 
-                drawCapsule({p1, p2, thickness}, color, clippingBehavior, objectId, render);
+                drawCapsule({p1, p2, thickness}, clippingBehavior, objectId, render);
             }
         }
     }
-    cout<<render.size()<<endl;
 }
 
 
 void Scene::drawMesh(
     const MeshGeometry& geometry,
     const Transformation& transformation,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId, 
     Render& render
@@ -315,7 +448,7 @@ void Scene::drawMesh(
     const auto& tMatrix = transformation.getMatrix();
     float maxScale = max(max(transformation.scale.x, transformation.scale.y), transformation.scale.z);
 
-    printf("2| n vert. of mesh: %d\n", vertices.size());
+    LOG_DEBUG("n vert. of mesh: %zu", vertices.size());
 
     bool isWireframe = geometry.isWireframe;
     if (isWireframe) {
@@ -328,7 +461,6 @@ void Scene::drawMesh(
                             matColMul(tMatrix, vertices[face[j]]),
                             geometry.thickness
                         },
-                        color,
                         clippingBehavior,
                         objectId,
                         render
@@ -346,7 +478,6 @@ void Scene::drawMesh(
                     matColMul(tMatrix, vertices[face[2]]), 
                     geometry.thickness
                 },
-                color,
                 clippingBehavior,
                 objectId,
                 render
@@ -357,7 +488,6 @@ void Scene::drawMesh(
 
 void Scene::drawText(
     const TextGeometry& geometry,
-    const Color& color,
     ClippingBehavior clippingBehavior,
     ObjectId objectId,
     Render& render
@@ -386,7 +516,7 @@ void Scene::drawText(
         Vec3<float> start = mapCoords(x1, y1);
         Vec3<float> end = mapCoords(x2, y2);
         CapsuleGeometry cap = {start, end, t};
-        drawCapsule(cap, color, clippingBehavior, objectId, render);
+        drawCapsule(cap, clippingBehavior, objectId, render);
     };
 
     for (char c : geometry.text) {
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "frameView.h"
+#include "log.h"
+
+const int SLICE_BYTES = tuple_size<decltype(ShmVoxelSlice::data)>::value;
+const int PLY_RECORD_BYTES = 3 * sizeof(float) + 3 + sizeof(uint16_t) + 1;
+
+static inline int dataIndex(const PointDisplayParams& params) {
+    return (static_cast<int>(!params.isDisplay1) * 128) + static_cast<int>(!params.isSide1) * 64 + params.rowIndex;
+}
+
+FrameView::FrameView(const UpdatePattern& pattern) {
+    int nSlices = 0;
+    for (const UpdatePatternPoint& point : pattern) {
+        nSlices = max(nSlices, point.pointDisplayParams.sliceIndex + 1);
+    }
+    positions.assign(nSlices * SLICE_BYTES, {});
+    placed.assign(nSlices * SLICE_BYTES, false);
+    columns.assign(nSlices, {});
+    boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+    boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const UpdatePatternPoint& point : pattern) {
+        const PointDisplayParams& params = point.pointDisplayParams;
+        int index = params.sliceIndex * SLICE_BYTES + dataIndex(params);
+        positions[index] = point.pos;
+        placed[index] = true;
+        columns[params.sliceIndex][params.isDisplay1 ? 0 : 1] = params.colIndex;
+        boundsMin = { min(boundsMin.x, point.pos.x), min(boundsMin.y, point.pos.y), min(boundsMin.z, point.pos.z) };
+        boundsMax = { max(boundsMax.x, point.pos.x), max(boundsMax.y, point.pos.y), max(boundsMax.z, point.pos.z) };
+    }
+}
+
+vector<LitVoxel> FrameView::litVoxels(const ShmVoxelSlice* frame, size_t* unplaced) const {
+    vector<LitVoxel> voxels;
+    size_t unplacedCount = 0;
+    for (int sliceIndex = 0; sliceIndex < (int) columns.size(); sliceIndex++) {
+        const ShmVoxelSlice& slice = frame[sliceIndex];
+        //a display showing another column than the pattern's lights voxels the pattern doesnt know
+        bool columnMatches[2] = { slice.index1 == columns[sliceIndex][0], slice.index2 == columns[sliceIndex][1] };
+        for (int i = 0; i < SLICE_BYTES; i++) {
+            uint8_t color = slice.data[i];
+            if (color == 0) continue;
+            int index = sliceIndex * SLICE_BYTES + i;
+            if (!placed[index] || !columnMatches[i / 128]) {
+                unplacedCount++;
+                continue;
+            }
+            voxels.push_back({ positions[index], (uint16_t) sliceIndex, (uint8_t) i, color });
+        }
+    }
+    if (unplaced != nullptr) *unplaced = unplacedCount;
+    return voxels;
+}
+
+ProjectionImage FrameView::project(const vector<LitVoxel>& voxels, ProjectionAxis axis, float pixelsPerUnit) const {
+    if (columns.empty()) return { 0, 0, {} };
+    //u goes right and v up in the image, depth grows towards the viewer
+    auto toView = [axis](const Vec3<float>& p) -> Vec3<float> {
+        switch (axis) {
+            case ProjectionAxis::TOP: return { p.x, p.y, p.z };
+            case ProjectionAxis::FRONT: return { p.x, p.z, -p.y };
+            case ProjectionAxis::SIDE: return { p.y, p.z, p.x };
+        }
+        return p;
+    };
+    Vec3<float> cornerA = toView(boundsMin);
+    Vec3<float> cornerB = toView(boundsMax);
+    float uMin = min(cornerA.x, cornerB.x), uMax = max(cornerA.x, cornerB.x);
+    float vMin = min(cornerA.y, cornerB.y), vMax = max(cornerA.y, cornerB.y);
+
+    ProjectionImage image;
+    image.width = (int) floor((uMax - uMin) * pixelsPerUnit) + 1;
+    image.height = (int) floor((vMax - vMin) * pixelsPerUnit) + 1;
+    image.rgb.assign(image.width * image.height * 3, 0);
+    vector<float> depth(image.width * image.height, -FLT_MAX);
+
+    for (const LitVoxel& voxel : voxels) {
+        Vec3<float> view = toView(voxel.pos);
+        int column = (int) floor((view.x - uMin) * pixelsPerUnit);
+        int row = (int) floor((vMax - view.y) * pixelsPerUnit);
+        if (column < 0 || column >= image.width || row < 0 || row >= image.height) continue;
+        int pixel = row * image.width + column;
+        if (view.z <= depth[pixel]) continue;
+        depth[pixel] = view.z;
+        image.rgb[pixel * 3] = voxel.color & 4 ? 255 : 0;
+        image.rgb[pixel * 3 + 1] = voxel.color & 2 ? 255 : 0;
+        image.rgb[pixel * 3 + 2] = voxel.color & 1 ? 255 : 0;
+    }
+    return image;
+}
+
+static string plyHeader(size_t vertexCount) {
+    return "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex " + to_string(vertexCount) + "\n"
+        "property float x\n"
+        "property float y\n"
+        "property float z\n"
+        "property uchar red\n"
+        "property uchar green\n"
+        "property uchar blue\n"
+        "property ushort slice\n"
+        "property uchar index\n"
+        "end_header\n";
+}
+
+//records are copied as they are in memory, the display and the machines it is tested on are little endian
+void writeLitVoxels(const vector<LitVoxel>& voxels, const string& path) {
+    string header = plyHeader(voxels.size());
+    vector<uint8_t> bytes(header.begin(), header.end());
+    bytes.resize(header.size() + voxels.size() * PLY_RECORD_BYTES);
+    uint8_t* out = bytes.data() + header.size();
+    for (const LitVoxel& voxel : voxels) {
+        float pos[3] = { voxel.pos.x, voxel.pos.y, voxel.pos.z };
+        memcpy(out, pos, sizeof(pos));
+        out[12] = voxel.color & 4 ? 255 : 0;
+        out[13] = voxel.color & 2 ? 255 : 0;
+        out[14] = voxel.color & 1 ? 255 : 0;
+        memcpy(out + 15, &voxel.sliceIndex, sizeof(uint16_t));
+        out[17] = voxel.dataIndex;
+        out += PLY_RECORD_BYTES;
+    }
+    ofstream file(path, ios::binary);
+    file.write((const char*) bytes.data(), bytes.size());
+    if (!file) LOG_ERROR("can't write %s", path.c_str());
+}
+
+bool readLitVoxels(const string& path, vector<LitVoxel>& voxels) {
+    ifstream file(path, ios::binary);
+    if (!file) return false;
+    string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t headerEnd = bytes.find("end_header\n");
+    size_t vertexCount;
+    if (headerEnd == string::npos || sscanf(bytes.c_str(), "ply\nformat binary_little_endian 1.0\nelement vertex %zu", &vertexCount) != 1) {
+        return false;
+    }
+    string header = plyHeader(vertexCount);
+    if (bytes.compare(0, header.size(), header) != 0 || bytes.size() != header.size() + vertexCount * PLY_RECORD_BYTES) {
+        return false;
+    }
+    voxels.resize(vertexCount);
+    const uint8_t* in = (const uint8_t*) bytes.data() + header.size();
+    for (LitVoxel& voxel : voxels) {
+        float pos[3];
+        memcpy(pos, in, sizeof(pos));
+        voxel.pos = { pos[0], pos[1], pos[2] };
+        voxel.color = (in[12] ? 4 : 0) | (in[13] ? 2 : 0) | (in[14] ? 1 : 0);
+        memcpy(&voxel.sliceIndex, in + 15, sizeof(uint16_t));
+        voxel.dataIndex = in[17];
+        in += PLY_RECORD_BYTES;
+    }
+    return true;
+}
+
+void writePpm(const ProjectionImage& image, const string& path) {
+    ofstream file(path, ios::binary);
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    file.write((const char*) image.rgb.data(), image.rgb.size());
+    if (!file) LOG_ERROR("can't write %s", path.c_str());
+}
+
+VoxelDiff diffLitVoxels(const vector<LitVoxel>& expected, const vector<LitVoxel>& actual) {
+    //both are in slice and data order, as litVoxels returns them
+    auto key = [](const LitVoxel& voxel) { return voxel.sliceIndex * SLICE_BYTES + voxel.dataIndex; };
+    VoxelDiff diff;
+    size_t i = 0, j = 0;
+    while (i < expected.size() || j < actual.size()) {
+        if (j == actual.size() || (i < expected.size() && key(expected[i]) < key(actual[j]))) {
+            diff.missing++;
+            i++;
+        } else if (i == expected.size() || key(actual[j]) < key(expected[i])) {
+            diff.extra++;
+            j++;
+        } else {
+            if (expected[i].color != actual[j].color) diff.recolored++;
+            i++;
+            j++;
+        }
+    }
+    return diff;
+}
@@ -2,58 +2,62 @@
 #include<iostream>
 #include<cmath>
 #include<cstdio>
+#include<algorithm>
 
 #include "types.h"
+#include "grid.h"
+#include "linalg.h"
+#include "log.h"
 
 using namespace std;
-inline int packIndex(int ix, int iy, int iz) {
-    return (ix << 22) | (iy << 11) | iz;
-}
 
-inline array<int, 3> unpackIndex(int packed) {
-    return { packed >> 22, (packed >> 11) & ((1 << 11) - 1), packed & ((1 << 11) - 1) };
-}
-int calculateIndex(const GridParams& params, const Vec3<float>& ptCoords) {
+array<int, 3> calculateCellCoords(const GridParams& params, const Vec3<float>& ptCoords) {
     const Vec3<float>& min = params.boundingBoxMin;
     const Vec3<float>& cellSizes = params.cellSizes;
 
-    int bitMax = pow(2, 10);
-
     int ix = floor((ptCoords.x - min.x) / cellSizes.x);
     int iy = floor((ptCoords.y - min.y) / cellSizes.y);
     int iz = floor((ptCoords.z - min.z) / cellSizes.z);
 
-    //ix - (10 bits), iy - (11 bits), iz - (11bits)
-    return packIndex(ix, iy, iz);
-
+    return { ix, iy, iz };
 }
-vector<int> calculateIndicesFromBB(const GridParams& params, const Vec3<float>& min, const Vec3<float>& max, float padding = 0.) {
+CellRange calculateCellRange(const GridParams& params, const Vec3<float>& minV, const Vec3<float>& maxV, float padding) {
     const Vec3<float>& boxMin = params.boundingBoxMin;
-    const Vec3<float>& boxMax = params.boundingBoxMax;
+    const Vec3<float>& cellSizes = params.cellSizes;
+    int lastCell = params.gridSize;
 
+    //clamping here means cells outside the grid are never visited
+    auto toCell = [&](float coord, float origin, float cellSize) {
+        return (int) clamp(floor((coord - origin) / cellSize), -1.f, (float) lastCell + 1);
+    };
+    //printf("---indices: bounding box min and max: %f %f %f, %f %f %f\n", minV.x, minV.y, minV.z, maxV.x, maxV.y, maxV.z);
+    return {
+        max(toCell(minV.x - padding, boxMin.x, cellSizes.x), 0),
+        max(toCell(minV.y - padding, boxMin.y, cellSizes.y), 0),
+        max(toCell(minV.z - padding, boxMin.z, cellSizes.z), 0),
+        min(toCell(maxV.x + padding, boxMin.x, cellSizes.x), lastCell),
+        min(toCell(maxV.y + padding, boxMin.y, cellSizes.y), lastCell),
+        min(toCell(maxV.z + padding, boxMin.z, cellSizes.z), lastCell),
+    };
+}
+tuple<Vec3<float>, Vec3<float>> calculateCellBounds(const GridParams& params, int ix, int iy, int iz) {
+    const Vec3<float>& boxMin = params.boundingBoxMin;
     const Vec3<float>& cellSizes = params.cellSizes;
+    const float epsilon = 1e-3; // covers rounding in calculateCellCoords
 
-    int minIx = floor((min.x - boxMin.x - padding) / cellSizes.x);
-    int minIy = floor((min.y - boxMin.y - padding) / cellSizes.y);
-    int minIz = floor((min.z - boxMin.z - padding) / cellSizes.z);
-
-    int maxIx = floor((max.x - boxMin.x + padding) / cellSizes.x);
-    int maxIy = floor((max.y - boxMin.y + padding) / cellSizes.y);
-    int maxIz = floor((max.z - boxMin.z + padding) / cellSizes.z);
-    //printf("---indices: bounding box min and max: %f %f %f, %f %f %f\n", min.x, min.y, min.z, max.x, max.y, max.z);
-    //printf("---min values: %d %d %d\n--max values: %d %d %d\n", minIx, minIy, minIz, maxIx, maxIy, maxIz);
-    vector<int> res;
-    res.reserve((maxIx - minIx + 1) * (maxIy - minIy + 1) * (maxIz - minIz + 1));
-    for (int ix = minIx; ix <= maxIx; ix++) {
-        for (int iy = minIy; iy <= maxIy; iy++) {
-            for (int iz = minIz; iz <= maxIz; iz++) {
-                res.push_back(packIndex(ix, iy, iz));
-            }
-        }
-    }
-    return res;
+    Vec3<float> cellMin = {
+        boxMin.x + ix * cellSizes.x - epsilon,
+        boxMin.y + iy * cellSizes.y - epsilon,
+        boxMin.z + iz * cellSizes.z - epsilon
+    };
+    Vec3<float> cellMax = {
+        boxMin.x + (ix + 1) * cellSizes.x + epsilon,
+        boxMin.y + (iy + 1) * cellSizes.y + epsilon,
+        boxMin.z + (iz + 1) * cellSizes.z + epsilon
+    };
+    return { cellMin, cellMax };
 }
-tuple<unordered_map<int, UpdatePattern>, GridParams> buildGrid(const UpdatePattern& points, int ptsPerCell) {
+SpatialGrid buildGrid(const UpdatePattern& points, int ptsPerCell) {
     int numPoints = points.size();
     int nCells = numPoints / ptsPerCell;
     int gridSize = ceil(pow(nCells, 1. / 3.));
@@ -73,30 +77,206 @@ tuple<unordered_map<int, UpdatePattern>, GridParams> buildGrid(const UpdatePatte
         Max.z = max(Max.z, ptCoords.z);
     }
 
-    cout << "grid size: " << gridSize << endl;
-    printf("Min: %f %f %f", Min.x, Min.y, Min.z);
-    printf("Max: %f %f %f", Max.x, Max.y, Max.z);
+    LOG_DEBUG("grid size: %d, min: %f %f %f, max: %f %f %f", gridSize, Min.x, Min.y, Min.z, Max.x, Max.y, Max.z);
 
     float cellSizeZ = (Max.z - Min.z) / gridSize;
     float cellSizeX = (Max.x - Min.x) / gridSize;
     float cellSizeY = (Max.y - Min.y) / gridSize;
 
-    GridParams params = {
+    SpatialGrid grid;
+    grid.params = {
         Min,
         Max,
         gridSize,
         Vec3 {cellSizeX, cellSizeY, cellSizeZ}
     };
-    cout << "cells sizes: " << cellSizeX << ", " << cellSizeY << ", " << cellSizeZ << endl;
-    unordered_map<int, UpdatePattern> map;
-
-    for (int i = 0; i < points.size(); i++) {
-        int packed = calculateIndex(params, points[i].pos);
-        auto& mapVal = map[packed];
-        mapVal.push_back(std::move(points[i]));
-        //array<int, 3> unpacked = unpackIndex(packed);
-        //if (unpacked != array<int, 3>{ix, iy, iz}) cout << "failed. reconstructed:" << endl;
-        //cout << bitset<32>(packed).to_string() << endl;
+    LOG_DEBUG("cells sizes: %f, %f, %f", cellSizeX, cellSizeY, cellSizeZ);
+
+    //counting sort by cell, keeps the order of points within a cell
+    int n = grid.cellsPerAxis();
+    vector<int> cellOfPoint(numPoints);
+    grid.cellStarts.assign(n * n * n + 1, 0);
+    for (int i = 0; i < numPoints; i++) {
+        auto [ix, iy, iz] = calculateCellCoords(grid.params, points[i].pos);
+        cellOfPoint[i] = grid.flatIndex(clamp(ix, 0, n - 1), clamp(iy, 0, n - 1), clamp(iz, 0, n - 1));
+        grid.cellStarts[cellOfPoint[i] + 1]++;
+    }
+    for (int i = 0; i < n * n * n; i++) {
+        grid.cellStarts[i + 1] += grid.cellStarts[i];
+    }
+    vector<uint32_t> fill(grid.cellStarts.begin(), grid.cellStarts.end() - 1);
+    grid.points.resize(numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        grid.points[fill[cellOfPoint[i]]++] = points[i];
+    }
+    return grid;
+}
+
+int CylindricalGridParams::radiusCell(float radius) const {
+    //only inner edges are searched so radii outside the grid land in the first or last cell
+    return upper_bound(radiusEdges.begin() + 1, radiusEdges.end() - 1, radius) - (radiusEdges.begin() + 1);
+}
+int CylindricalGridParams::angleCell(float angle) const {
+    int ia = (int) floor(angle / angleStep) % nAngles;
+    return ia < 0 ? ia + nAngles : ia;
+}
+int CylindricalGridParams::zCell(float z) const {
+    return clamp((int) floor((z - zMin) / zStep), 0, nZ - 1);
+}
+
+//range of cells between two radii, two angles (end may be past 2pi) and two heights
+static CylindricalCellRange cylindricalCellRange(
+    const CylindricalGridParams& params,
+    float radiusNear, float radiusFar,
+    bool allAngles, float startAngle, float endAngle,
+    float z0, float z1
+) {
+    const float epsilon = 1e-3; // same slack as the cell bounds
+
+    if (z1 < params.zMin || z0 > params.zMin + params.zStep * params.nZ) {
+        return { 0, -1, 0, 0, 0, -1 }; // nothing to visit
+    }
+    CylindricalCellRange range;
+    range.minIz = params.zCell(z0);
+    range.maxIz = params.zCell(z1);
+    range.minIr = params.radiusCell(radiusNear - epsilon);
+    range.maxIr = params.radiusCell(radiusFar + epsilon);
+
+    if (allAngles || radiusNear <= epsilon) {
+        range.minIa = 0;
+        range.angleCount = params.nAngles;
+        return range;
+    }
+    float angleEpsilon = epsilon / radiusNear;
+    startAngle -= angleEpsilon;
+    endAngle += angleEpsilon;
+    int first = (int) floor(startAngle / params.angleStep);
+    int last = (int) floor(endAngle / params.angleStep);
+    range.minIa = params.angleCell(startAngle);
+    range.angleCount = min(last - first + 1, params.nAngles);
+    return range;
+}
+
+CylindricalCellRange calculateCellRange(const CylindricalGridParams& params, const Vec3<float>& minV, const Vec3<float>& maxV, float padding) {
+    if (minV == maxV) { // a padded point is a sphere, which has a tighter range than its box
+        return calculateCellRange(params, minV, padding);
+    }
+    float x0 = minV.x - padding, x1 = maxV.x + padding;
+    float y0 = minV.y - padding, y1 = maxV.y + padding;
+
+    //closest and farthest point of the box from the axis
+    float nearX = clamp(0.f, x0, x1);
+    float nearY = clamp(0.f, y0, y1);
+    float farX = max(abs(x0), abs(x1));
+    float farY = max(abs(y0), abs(y1));
+    float radiusNear = sqrt(nearX * nearX + nearY * nearY);
+    float radiusFar = sqrt(farX * farX + farY * farY);
+
+    //if the box doesnt contain the axis, its angular span is less than pi and given by the corners
+    float centerAngle = atan2((y0 + y1) / 2, (x0 + x1) / 2);
+    float lo = 0, hi = 0;
+    for (float cx : {x0, x1}) {
+        for (float cy : {y0, y1}) {
+            float rel = remainder(atan2(cy, cx) - centerAngle, 2 * (float) M_PI);
+            lo = min(lo, rel);
+            hi = max(hi, rel);
+        }
+    }
+    return cylindricalCellRange(params, radiusNear, radiusFar, false, centerAngle + lo, centerAngle + hi, minV.z - padding, maxV.z + padding);
+}
+
+CylindricalCellRange calculateCellRange(const CylindricalGridParams& params, const Vec3<float>& center, float radius) {
+    float centerRadius = sqrt(center.x * center.x + center.y * center.y);
+    bool allAngles = centerRadius <= radius;
+    float centerAngle = atan2(center.y, center.x);
+    float halfAngle = allAngles ? 0 : asin(radius / centerRadius);
+    return cylindricalCellRange(
+        params,
+        max(centerRadius - radius, 0.f), centerRadius + radius,
+        allAngles, centerAngle - halfAngle, centerAngle + halfAngle,
+        center.z - radius, center.z + radius
+    );
+}
+
+tuple<Vec3<float>, Vec3<float>> calculateCellBounds(const CylindricalGridParams& params, int ir, int ia, int iz) {
+    const float epsilon = 1e-3;
+
+    float r0 = params.radiusEdges[ir];
+    float r1 = params.radiusEdges[ir + 1];
+    float a0 = ia * params.angleStep;
+    float a1 = a0 + params.angleStep;
+
+    Vec3<float> cellMin = { __FLT_MAX__, __FLT_MAX__, params.zMin + iz * params.zStep - epsilon };
+    Vec3<float> cellMax = { -__FLT_MAX__, -__FLT_MAX__, params.zMin + (iz + 1) * params.zStep + epsilon };
+    auto include = [&](float r, float a) {
+        float x = r * cos(a), y = r * sin(a);
+        cellMin.x = min(cellMin.x, x); cellMin.y = min(cellMin.y, y);
+        cellMax.x = max(cellMax.x, x); cellMax.y = max(cellMax.y, y);
+    };
+    include(r0, a0); include(r0, a1);
+    include(r1, a0); include(r1, a1);
+    //the outer arc bulges past the corners where it crosses an axis
+    for (int quarter = (int) ceil(a0 / (M_PI / 2)); quarter * (M_PI / 2) <= a1; quarter++) {
+        include(r1, quarter * (M_PI / 2));
+    }
+    cellMin.x -= epsilon; cellMin.y -= epsilon;
+    cellMax.x += epsilon; cellMax.y += epsilon;
+    return { cellMin, cellMax };
+}
+
+CylindricalGrid buildCylindricalGrid(const UpdatePattern& points, int ptsPerCell) {
+    int numPoints = points.size();
+    int nCells = max(numPoints / ptsPerCell, 1);
+    float cellsPerAxis = pow(nCells, 1. / 3.);
+
+    CylindricalGrid grid;
+    CylindricalGridParams& params = grid.params;
+
+    params.zMin = __FLT_MAX__;
+    float zMax = -__FLT_MAX__;
+    vector<float> radii(numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        const Vec3<float>& pos = points[i].pos;
+        radii[i] = sqrt(pos.x * pos.x + pos.y * pos.y);
+        params.zMin = min(params.zMin, pos.z);
+        zMax = max(zMax, pos.z);
+    }
+
+    params.nZ = max((int) round(cellsPerAxis), 1);
+    params.nRadii = max((int) round(cellsPerAxis / 3), 1); // rings are narrow near the rim where most points are
+    params.zStep = max(zMax - params.zMin, 1.f) / params.nZ;
+    params.zStep *= 1.0001; // keeps the top row inside the last cell
+
+    params.nAngles = max(nCells / (params.nZ * params.nRadii), 1); // the angle cells fill the remaining cells
+    params.angleStep = 2 * M_PI / params.nAngles;
+
+    //radial edges at quantiles of the point radii, so every ring holds the same number of points
+    vector<float> sortedRadii = radii;
+    sort(sortedRadii.begin(), sortedRadii.end());
+    params.radiusEdges.assign(params.nRadii + 1, 0);
+    for (int k = 1; k < params.nRadii; k++) {
+        params.radiusEdges[k] = sortedRadii[(size_t) k * numPoints / params.nRadii];
+    }
+    params.radiusEdges[params.nRadii] = sortedRadii.back();
+
+    LOG_DEBUG("cylindrical grid: %d radii, %d angles, %d z", params.nRadii, params.nAngles, params.nZ);
+
+    //counting sort by cell, same as buildGrid
+    int totalCells = params.nRadii * params.nAngles * params.nZ;
+    vector<int> cellOfPoint(numPoints);
+    grid.cellStarts.assign(totalCells + 1, 0);
+    for (int i = 0; i < numPoints; i++) {
+        const Vec3<float>& pos = points[i].pos;
+        cellOfPoint[i] = grid.flatIndex(params.radiusCell(radii[i]), params.angleCell(atan2(pos.y, pos.x)), params.zCell(pos.z));
+        grid.cellStarts[cellOfPoint[i] + 1]++;
+    }
+    for (int i = 0; i < totalCells; i++) {
+        grid.cellStarts[i + 1] += grid.cellStarts[i];
+    }
+    vector<uint32_t> fill(grid.cellStarts.begin(), grid.cellStarts.end() - 1);
+    grid.points.resize(numPoints);
+    for (int i = 0; i < numPoints; i++) {
+        grid.points[fill[cellOfPoint[i]]++] = points[i];
     }
-    return { map, params };
+    return grid;
 }
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <filesystem>
 #include "types.h"
+#include "log.h"
 using namespace std;
 
 vector<float> getFloats(string str) {
@@ -52,7 +53,7 @@ vector<float> extractPointCloudData(string str, int nDataPoints = 6) {
     if (str.find(".") == string::npos || str == "format ascii 1.0") return res;
     for (int i = 0; i < nDataPoints - 1; i++) {
         if ((pos_end = str.find(" ", pos_start)) == string::npos) {
-            cout << "warning: Not enough values in string: " << str << endl;
+            LOG_WARN("not enough values in string: %s", str.c_str());
             return res;
         }
         token = str.substr(pos_start, pos_end - pos_start);
@@ -143,7 +144,7 @@ Mesh loadMeshObj(string path) {
             array<int, 3> face;
 
             vector<string> faceInfo = split(str.substr(2));
-            if (faceInfo.size() > 3) cerr << "Warning: obj file has face with more than 3 vertices";
+            if (faceInfo.size() > 3) LOG_WARN("obj file has face with more than 3 vertices");
             for (int i = 0; i < 3; i++) {
                 string vertexIndexStr = split(faceInfo[i], "/")[0];
                 face[i] = (stoi(vertexIndexStr)) - 1; //ply indexing starts from 1
@@ -166,7 +167,7 @@ bool comparePatterns(const UpdatePatternPoint& p1, const UpdatePatternPoint& p2)
 }
 
 UpdatePattern loadUpdatePattern(string path) {
-    cout<<"loading update pattern file into memory"<<endl;
+    LOG_INFO("loading update pattern file into memory");
     ifstream file(path);
     stringstream buffer;
 
@@ -175,7 +176,7 @@ UpdatePattern loadUpdatePattern(string path) {
 
     vector<string> splitFileStr = split(fileStr, "\n");
     UpdatePattern res;
-    cout<<"parsing update pattern file"<<endl;
+    LOG_INFO("parsing update pattern file");
     for (const string& line : splitFileStr) {
         if (line == "") continue;
         vector<string> lineInfo = split(line);
@@ -0,0 +1,98 @@
+#include<vector>
+#include<cmath>
+#include<iostream>
+#include<algorithm>
+
+#include "types.h"
+#include "locator.h"
+#include "linalg.h"
+#include "log.h"
+
+using namespace std;
+
+int VoxelLocator::sliceWindows(float x, float y, float radius, bool isDisplay1, array<SliceWindow, 2>& windows) const {
+    const float epsilon = 1e-3; // pattern positions are rounded
+    float offset = isDisplay1 ? 0 : PANEL_2_OFFSET;
+    float rho = sqrt(x * x + y * y);
+    radius += epsilon;
+
+    if (rho < epsilon) {
+        if (offset > radius) return 0;
+        windows[0] = { 0, nSlices - 1 };
+        return 1;
+    }
+
+    //the column line at angle a passes |rho * sin(theta - a) - offset| from the point,
+    //so phi = theta - a needs sin(phi) in [lo, hi]
+    float theta = atan2(y, x);
+    float lo = (offset - radius) / rho;
+    float hi = (offset + radius) / rho;
+
+    int n = 0;
+    auto addWindow = [&](float phiLo, float phiHi) {
+        float first = ceil((theta - phiHi) / sliceAngle);
+        float last = floor((theta - phiLo) / sliceAngle);
+        if (last < first) return;
+        if (last - first + 1 >= nSlices) {
+            windows[n++] = { 0, nSlices - 1 };
+            return;
+        }
+        int shift = (int) floor(first / nSlices) * nSlices;
+        windows[n++] = { (int) first - shift, (int) last - shift };
+    };
+
+    if (lo > 1 || hi < -1) return 0;
+    if (lo <= -1 && hi >= 1) addWindow(0, 2 * M_PI);
+    else if (hi >= 1) addWindow(asin(lo), M_PI - asin(lo));
+    else if (lo <= -1) addWindow(M_PI - asin(hi), 2 * M_PI + asin(hi));
+    else {
+        addWindow(asin(lo), asin(hi));
+        addWindow(M_PI - asin(hi), M_PI - asin(lo));
+    }
+    return n;
+}
+
+bool VoxelLocator::nearestVoxel(const Vec3<float>& pos, float maxDistance, PointDisplayParams& params, Vec3<float>& voxelPos) const {
+    //voxels are about a unit apart along the columns, so a unit ball mostly has some. it grows until one is found,
+    //the closest voxel within the first radius that has any is the closest one overall
+    for (float radius = min(1.f, maxDistance); ; radius = min(radius * 2, maxDistance)) {
+        float best = INFINITY;
+        forEachVoxel(pos, radius, [&](const SliceColumn& column, int row) {
+            Vec3<float> voxel = { column.x, column.y, column.z0 + row };
+            float distance2 = magnitude_2(voxel - pos);
+            if (distance2 >= best) return;
+            best = distance2;
+            params = column.base;
+            params.rowIndex = row;
+            voxelPos = voxel;
+        });
+        if (best <= radius * radius) return true;
+        if (radius >= maxDistance) return false;
+    }
+}
+
+VoxelLocator buildVoxelLocator(const UpdatePattern& points) {
+    VoxelLocator locator;
+
+    //every column of the pattern has a row 0 point
+    for (const UpdatePatternPoint& pt : points) {
+        locator.nSlices = max(locator.nSlices, pt.pointDisplayParams.sliceIndex + 1);
+    }
+    locator.sliceAngle = 2 * M_PI / max(locator.nSlices, 1);
+
+    locator.sliceStarts.assign(locator.nSlices + 1, 0);
+    for (const UpdatePatternPoint& pt : points) {
+        if (pt.pointDisplayParams.rowIndex == 0) locator.sliceStarts[pt.pointDisplayParams.sliceIndex + 1]++;
+    }
+    for (int i = 0; i < locator.nSlices; i++) {
+        locator.sliceStarts[i + 1] += locator.sliceStarts[i];
+    }
+    vector<uint32_t> fill(locator.sliceStarts.begin(), locator.sliceStarts.end() - 1);
+    locator.columns.resize(locator.sliceStarts.back());
+    for (const UpdatePatternPoint& pt : points) {
+        if (pt.pointDisplayParams.rowIndex != 0) continue;
+        locator.columns[fill[pt.pointDisplayParams.sliceIndex]++] = { pt.pos.x, pt.pos.y, pt.pos.z, pt.pointDisplayParams, pt.normal };
+    }
+    LOG_DEBUG("voxel locator: %zu columns in %d slices", locator.columns.size(), locator.nSlices);
+    return locator;
+}
@@ -1,5 +1,6 @@
 #include"types.h"
 #include"linalg.h"
+#include "log.h"
 #include <algorithm>
 #include <iostream>
 
@@ -46,8 +47,9 @@ void Mesh::center(float padding) {
     float scaleZ = (meshSize.z > 0) ? targetSize.z / meshSize.z : 1.0f;
 
     float scaleFactor = std::min({scaleX, scaleY, scaleZ});
-    std::cout<<"calculated mesh center: "<<meshCenter << ", bounds center: " <<boundsCenter << ", scale factor: " <<scaleFactor<<std::endl;
-    std::cout << "min: " << min << ", max: " << max<<std::endl;
+    LOG_DEBUG("calculated mesh center: %f %f %f, bounds center: %f %f %f, scale factor: %f",
+        meshCenter.x, meshCenter.y, meshCenter.z, boundsCenter.x, boundsCenter.y, boundsCenter.z, scaleFactor);
+    LOG_DEBUG("min: %f %f %f, max: %f %f %f", min.x, min.y, min.z, max.x, max.y, max.z);
     for (auto& v : vertices) {
         v = v - meshCenter;
         v = v * scaleFactor;
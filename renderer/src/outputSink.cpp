@@ -0,0 +1,182 @@
+#include <chrono>
+#include <unistd.h>
+
+#include "outputSink.h"
+#include "gpioPacking.h"
+#include "log.h"
+
+template<typename Frame>
+static void writeVoxels(Frame& frame, const Render& render) {
+    for (const RenderedPoint& renderedPoint : render) {
+        const PointDisplayParams& params = renderedPoint.pointDisplayParams;
+        ShmVoxelSlice& targetSlice = frame[params.sliceIndex];
+        uint8_t& colIndex = params.isDisplay1 ? targetSlice.index1 : targetSlice.index2;
+        colIndex = params.colIndex;
+
+        int baseIndexNumber = (static_cast<int>(!params.isDisplay1) * 128) + static_cast<int>(!params.isSide1)*64;
+        targetSlice.data[baseIndexNumber+params.rowIndex] = static_cast<uint8_t>(renderedPoint.color);
+    }
+}
+
+static ShmDirtySlices dirtySlices(const Render& render) {
+    ShmDirtySlices slices = {};
+    for (const RenderedPoint& renderedPoint : render) {
+        int sliceIndex = renderedPoint.pointDisplayParams.sliceIndex;
+        slices[sliceIndex / 64] |= 1ull << (sliceIndex % 64);
+    }
+    return slices;
+}
+
+ShmSink::ShmSink() {
+    LOG_INFO("opening shm...");
+    shmPointer = openShm("vdshm");
+    if (shmPointer == nullptr) {
+        LOG_ERROR("SHM failed to open");
+        return;
+    }
+    LOG_INFO("wiping voxel data...");
+    for (auto& slice : shmPointer->data) {
+        for (auto& voxel : slice.data) {
+            voxel = 0;
+        }
+    }
+    for (auto& slice : shmPointer->packedData) {
+        slice.rows.fill(0);
+    }
+    markAllDirty(shmPointer->layers.dataDirty);
+    resetFrameQueue(shmPointer);
+    notifyAll(shmPointer->notify.frame); // the driver drops a frame a previous app queued for the wiped data
+}
+
+ShmSink::ShmSink(int layerZOrder, ShmBlendMode layerBlend) {
+    LOG_INFO("opening shm...");
+    shmPointer = openShm("vdshm");
+    if (shmPointer == nullptr) {
+        LOG_ERROR("SHM failed to open");
+        return;
+    }
+    layer = claimLayer(shmPointer, getpid(), layerZOrder, layerBlend);
+    if (layer < 0) {
+        LOG_WARN("all %d layers are taken, drawing into the main frame", LAYER_COUNT);
+    }
+}
+
+ShmVoxelFrame& ShmSink::targetFrame() {
+    return layer < 0 ? shmPointer->data : shmPointer->layers.layers[layer].data;
+}
+
+ShmDirtySlices& ShmSink::targetDirty() {
+    return layer < 0 ? shmPointer->layers.dataDirty : shmPointer->layers.layers[layer].dirty;
+}
+
+void ShmSink::write(const Render& changes) {
+    if (shmPointer == nullptr) return;
+    if (layer >= 0) {
+        writeVoxels(targetFrame(), changes);
+        markDirty(targetDirty(), dirtySlices(changes));
+    } else if (!queuedState.empty()) {
+        //queued renders hold changes the live data never got, so the whole frame goes out. the ones not shown
+        //yet are older than this render and would revert it later
+        resetFrameQueue(shmPointer);
+        writeVoxels(queuedState, changes);
+        copy(queuedState.begin(), queuedState.end(), shmPointer->data.begin());
+        markAllDirty(shmPointer->layers.dataDirty);
+        if (shmPointer->frameFormat == PACKED_GPIO) {
+            for (int i = 0; i < shmPointer->data.size(); i++) {
+                packSlice(shmPointer->data[i], shmPointer->packedData[i]);
+            }
+        }
+        notifyAll(shmPointer->notify.frame);
+    } else {
+        writeVoxels(shmPointer->data, changes);
+        markDirty(shmPointer->layers.dataDirty, dirtySlices(changes));
+        if (shmPointer->frameFormat == PACKED_GPIO) {
+            ShmPackedFrame& packedFrame = shmPointer->packedData;
+            for (const RenderedPoint& renderedPoint : changes) {
+                const PointDisplayParams& params = renderedPoint.pointDisplayParams;
+                ShmPackedSlice& targetSlice = packedFrame[params.sliceIndex];
+                (params.isDisplay1 ? targetSlice.index1 : targetSlice.index2) = params.colIndex;
+
+                uint32_t& regVal = targetSlice.rows[63-params.rowIndex];
+                regVal = (regVal & ~sideMask(params.isDisplay1, params.isSide1))
+                       | packVoxel(static_cast<uint8_t>(renderedPoint.color), params.isDisplay1, params.isSide1);
+            }
+        }
+        notifyAll(shmPointer->notify.frame);
+    }
+}
+
+void ShmSink::writeAt(const Render& changes, int64_t presentTime) {
+    if (shmPointer == nullptr) return;
+    if (layer >= 0) {
+        write(changes); // layers have no queue
+        return;
+    }
+    if (queuedState.empty()) {
+        queuedState.assign(shmPointer->data.begin(), shmPointer->data.end());
+    }
+    writeVoxels(queuedState, changes);
+
+    int slot = waitQueuedFrame(shmPointer);
+    copy(queuedState.begin(), queuedState.end(), shmPointer->frameQueue.frames[slot].data.begin());
+    submitQueuedFrame(shmPointer, slot, presentTime);
+}
+
+void ShmSink::wipe() {
+    if (shmPointer == nullptr) return;
+    for (auto& slice : queuedState) {
+        slice.data.fill(0);
+    }
+    ShmVoxelFrame& frame = targetFrame();
+    for (auto& slice : frame) {
+        for (auto& voxel : slice.data) {
+            voxel = 0;
+        }
+    }
+    markAllDirty(targetDirty());
+    if (layer >= 0) return;
+    for (auto& slice : shmPointer->packedData) {
+        slice.rows.fill(0);
+    }
+}
+
+void ShmSink::setFrameFormat(ShmFrameFormat format) {
+    if (shmPointer == nullptr || layer >= 0) return;
+    if (format == PACKED_GPIO && shmPointer->frameFormat != PACKED_GPIO) {
+        //bring the packed frame up to date before the driver switches to it
+        for (int i = 0; i < shmPointer->data.size(); i++) {
+            packSlice(shmPointer->data[i], shmPointer->packedData[i]);
+        }
+    }
+    shmPointer->frameFormat = format;
+}
+
+void FramebufferSink::write(const Render& changes) {
+    writeVoxels(frame, changes);
+    ShmDirtySlices changed = dirtySlices(changes);
+    for (int i = 0; i < DIRTY_WORDS; i++) {
+        dirty[i] |= changed[i];
+    }
+    renders++;
+}
+
+void FramebufferSink::wipe() {
+    for (auto& slice : frame) {
+        slice.data.fill(0);
+    }
+    dirty.fill(~0ull);
+}
+
+VdvSink::VdvSink(const string& path, uint32_t keyframeInterval) {
+    writer.open(path, keyframeInterval);
+}
+
+void VdvSink::write(const Render& changes) {
+    writeAt(changes, chrono::steady_clock::now().time_since_epoch().count());
+}
+
+void VdvSink::writeAt(const Render& changes, int64_t presentTime) {
+    FramebufferSink::write(changes);
+    writer.addFrame(frame.data(), presentTime, &dirty);
+    clearDirty();
+}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <chrono>
 #include <cmath>
+#include <unistd.h>
 
 #include "types.h"
 #include "linalg.h"
@@ -11,6 +12,8 @@
 #include "renderer.h"
 #include "dither.h"
 #include "shm.h"
+#include "log.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -117,7 +120,7 @@ Geometry Object::getTransformedGeometry() {
                 {0, 0, 1, 0},
                 {0, 0, 0, 1}
             }}) {
-                cerr<<"Warning: Transformation logic for text is not implemented. change geometry instead."<<endl;
+                LOG_WARN("transformation logic for text is not implemented. change geometry instead.");
             }
         }
         else
@@ -150,32 +153,61 @@ void Object::setPivot(Vec3<float> pivot) {
     transformation.pivot = pivot;
     toRerender = true;
 }
+void Object::setAnimation(shared_ptr<const Animation> newAnimation, int64_t startTime) {
+    animation = newAnimation;
+    animationStart = startTime;
+}
+void Object::sampleAnimation(int64_t time) {
+    if (animationStart == 0) animationStart = time;
+    double elapsed = (time - animationStart) / 1e9;
+    float duration = animation->duration();
+    bool ended = !animation->loop && elapsed >= duration;
+    if (animation->loop && duration > 0) elapsed = fmod(elapsed, duration);
 
-Scene::Scene() {
-    cout<<"loading update pattern..."<<endl;
-    UpdatePattern updatePattern = loadUpdatePattern("../../update_pattern_gen/output.txt");
-    cout<<"building grid..."<<endl;
-    auto [mapping_, params_] = buildGrid(updatePattern, 20);
-    mapping = mapping_;
-    params = params_;
-    lastId = 0;
+    auto apply = [&](const auto& track, auto& value) {
+        if (track.empty()) return;
+        auto sampled = track.sample(elapsed);
+        if (sampled == value) return; // holding still costs no redraw
+        value = sampled;
+        toRerender = true;
+    };
+    apply(animation->translation, transformation.translation);
+    apply(animation->rotation, transformation.rotation);
+    apply(animation->scale, transformation.scale);
+    apply(animation->color, color);
+    if (ended) animation = nullptr;
+}
 
-    cout<<"opening shm..."<<endl;
+const double nominalRevolutionNs = 1e9 / 24; // the rotor's target speed, stands in for it when headless
 
-    shmPointer = openShm("vdshm");
-    if (shmPointer == nullptr) { 
-        printf("SHM failed to open");
-        return; 
-    }
-    cout<<"wiping voxel data..."<<endl;
-    for (auto& slice : shmPointer->data) {
-        for (auto& voxel : slice.data) {
-            voxel = 0;
-        }
+Scene::Scene(const SceneConfig& config) {
+    if (config.updatePattern != nullptr) {
+        LOG_INFO("building grid...");
+        grid = buildGrid(*config.updatePattern, 20);
+        voxelLocator = buildVoxelLocator(*config.updatePattern);
+    } else {
+        LOG_INFO("loading update pattern...");
+        UpdatePattern updatePattern = loadUpdatePattern(config.updatePatternPath);
+        LOG_INFO("building grid...");
+        grid = buildGrid(updatePattern, 20);
+        voxelLocator = buildVoxelLocator(updatePattern);
     }
+    lastId = 0;
+
+    sink = config.sink != nullptr ? config.sink : make_shared<ShmSink>();
+    shmPointer = sink->shm();
+    if (shmPointer == nullptr) return;
+    seenKeys = loadNotify(shmPointer->notify.key);
+    seenRevolution = loadNotify(shmPointer->notify.revolution);
+    keyEventCursor = keyEventHead(shmPointer); // presses from before the app started are not ours
 }
+
+Scene::Scene() : Scene(SceneConfig{}) {}
+
+Scene::Scene(int layerZOrder, ShmBlendMode layerBlend) : Scene(SceneConfig{ .sink = make_shared<ShmSink>(layerZOrder, layerBlend) }) {}
+
 ObjectId Scene::nextId() {
-    printf("next id: %d", lastId+1);
+    LOG_DEBUG("next id: %u", lastId+1);
     return ++lastId;
 }
 ObjectId Scene::createObject(const Geometry& initGeometry, const Color& initColor, ClippingBehavior initClippingBehavior) {
@@ -193,13 +225,18 @@ Object& Scene::getObject(ObjectId id) {
         }
     }
     throw invalid_argument("No object found with this id.");
-    cerr<<"No object found"<<endl;
+    LOG_ERROR("no object found");
 }
 void Scene::setObjectGeometry(ObjectId id, Geometry newGeometry) {
     auto& object = getObject(id);
     object.setGeometry(newGeometry);
 }
 
+void Scene::setObjectColor(ObjectId id, Color newColor) {
+    auto& object = getObject(id);
+    object.setColor(newColor);
+}
+
 void Scene::setObjectTranslation(ObjectId id, Vec3<float> translation) {
     auto& object = getObject(id);
     object.translate(translation);
@@ -220,62 +257,191 @@ void Scene::setObjectIntrinsicPivot(ObjectId id, Vec3<float> newPivot) {
     object.setPivot(newPivot);
 }
 
-void Scene::render(bool writeToFile) {
-    printf("rendering %d objects\n", objects.size());
-    Render render;
-    for (auto objToRemove : toRemove) {
-        for (RenderedPoint& lastRenderPoint : lastRender) {
-            if (lastRenderPoint.objectId == objToRemove) {
-                lastRenderPoint.objectId = (ObjectId)-1; // uint32_t max
-                lastRenderPoint.color = BLACK;
-                render.push_back(lastRenderPoint);
-            }
-        }
+void Scene::animateObject(ObjectId id, shared_ptr<const Animation> animation, int64_t startTime) {
+    auto& object = getObject(id);
+    object.setAnimation(animation, startTime);
+}
+
+void Scene::stopAnimation(ObjectId id) {
+    auto& object = getObject(id);
+    object.setAnimation(nullptr);
+}
+
+bool Scene::isAnimating() const {
+    return any_of(objects.begin(), objects.end(), [](const Object& object) { return object.isAnimated(); });
+}
+
+void Scene::sampleAnimations(int64_t time) {
+    TraceSpan span("animate", "renderer");
+    int64_t changed = 0;
+    for (Object& object : objects) {
+        if (!object.isAnimated()) continue;
+        bool wasChanged = object.toRerender;
+        object.sampleAnimation(time);
+        changed += object.toRerender && !wasChanged;
     }
+    span.argNames[0] = "changed";
+    span.args[0] = changed;
+}
+
+void Scene::drawChanges() {
+    LOG_DEBUG("rendering %zu objects", objects.size());
+    stats = {};
+    Render& render = renderBuffer;
+    render.clear();
+    int64_t start = steadyNs();
+    render.insert(render.end(), toErase.begin(), toErase.end());
+    stats.pointsErased += toErase.size();
+    int64_t end = steadyNs();
+    stats.diffNs += end - start;
+    if (!toErase.empty()) traceComplete("erase removed", "renderer", start, end, "points", toErase.size());
+    toErase.clear();
     for (Object& object : objects) {
         if (object.toRerender) {
             draw(object, render);
             object.toRerender = false;
         }
     }
-    printf("writing render with %d points\n", render.size());
-    lastRender = render;
+    LOG_DEBUG("writing render with %zu points", render.size());
+    swap(lastRender, renderBuffer); // old lastRender becomes next render's scratch buffer
+}
+
+void Scene::render(bool writeToFile) {
+    TraceSpan span("render", "renderer");
+    int64_t start = steadyNs();
+    sampleAnimations(start);
+    drawChanges();
+    span.argNames = { "objects", "points" };
+    span.args = { (int64_t) stats.objectsRedrawn, (int64_t) lastRender.size() };
     if (writeToFile) {
-        writeRenderToFile(render, "output/render.ply");
+        writeRenderToFile(lastRender, "output/render.ply");
     } else {
-        ShmVoxelFrame& frame = shmPointer->data;
-        for (const RenderedPoint& renderedPoint : render) {
-            const PointDisplayParams& params = renderedPoint.pointDisplayParams;
-            ShmVoxelSlice& targetSlice = frame[params.sliceIndex];
-            uint8_t& colIndex = params.isDisplay1 ? targetSlice.index1 : targetSlice.index2;
-            colIndex = params.colIndex;
-
-            int baseIndexNumber = (static_cast<int>(!params.isDisplay1) * 128) + static_cast<int>(!params.isSide1)*64;
-            targetSlice.data[baseIndexNumber+params.rowIndex] = static_cast<uint8_t>(renderedPoint.color);
-        }
+        TraceSpan writeSpan("write", "renderer", "points", lastRender.size());
+        ScopedTimer timer(stats.writeNs);
+        sink->write(lastRender);
     }
+    stats.totalNs = steadyNs() - start;
+    publishStats();
+}
+
+void Scene::renderAt(int64_t presentTime) {
+    TraceSpan span("render", "renderer");
+    int64_t start = steadyNs();
+    sampleAnimations(presentTime);
+    drawChanges();
+    span.argNames = { "objects", "points" };
+    span.args = { (int64_t) stats.objectsRedrawn, (int64_t) lastRender.size() };
+    {
+        TraceSpan writeSpan("write", "renderer", "points", lastRender.size(), "presentTime", presentTime);
+        ScopedTimer timer(stats.writeNs);
+        sink->writeAt(lastRender, presentTime);
+    }
+    stats.totalNs = steadyNs() - start;
+    publishStats();
+}
+
+void Scene::publishStats() {
+    renderCount++;
+    if (shmPointer == nullptr) return;
+    TraceSpan span("publish stats", "renderer");
+    ShmRenderStats shared = {
+        .sequence = 0, // set by writeRenderStats
+        .pid = (uint32_t) getpid(),
+        .renders = renderCount,
+        .pointsTested = stats.pointsTested,
+        .pointsEmitted = stats.pointsEmitted,
+        .pointsErased = stats.pointsErased,
+        .objectsRedrawn = (uint32_t) stats.objectsRedrawn,
+        .objects = (uint32_t) objects.size(),
+        .transformNs = stats.transformNs,
+        .cellsNs = stats.cellsNs,
+        .testsNs = stats.testsNs,
+        .ditherNs = stats.ditherNs,
+        .diffNs = stats.diffNs,
+        .writeNs = stats.writeNs,
+        .totalNs = stats.totalNs,
+    };
+    writeRenderStats(shmPointer, shared);
+}
+
+int64_t Scene::revolutionTime(int revolutionsAhead) {
+    int64_t now = chrono::steady_clock::now().time_since_epoch().count();
+    if (shmPointer == nullptr) return now + (revolutionsAhead - 1) * nominalRevolutionNs;
+    ShmTiming timing = readTiming(shmPointer);
+    ShmRotation rotation = timing.rotation;
+    if (rotation.velocity <= 0) {
+        if (timing.nextFrameDuration == 0) return now; // nothing spinning yet
+        rotation = { timing.nextFrameStart, 0, 1e9 / timing.nextFrameDuration, 0 };
+    }
+    //whole revolutions still ahead of now, the driver starts them at whole phases
+    double phase = round(rotation.phase);
+    while (timeAtPhase(rotationUpTo(rotation, phase + revolutionsAhead - 1), phase) <= now) phase++;
+    return timeAtPhase(rotationUpTo(rotation, phase + revolutionsAhead - 1), phase + revolutionsAhead - 1);
 }
 
 void Scene::wipe() {
     objects = {};
-    ShmVoxelFrame& frame = shmPointer->data;
-    for (auto& slice : frame) {
-        for (auto& voxel : slice.data) {
-            voxel = 0;
-        }
-    }
+    toErase.clear();
+    sink->wipe();
 }
 
 void Scene::removeObject(ObjectId objectId) {
-    toRemove.push_back(objectId);
     for (int i = 0; i < objects.size(); i++) {
         if (objects[i].getId() == objectId) {
+            for (RenderedPoint erased : objects[i].drawnPoints) {
+                erased.objectId = (ObjectId)-1; // uint32_t max
+                erased.color = BLACK;
+                toErase.push_back(erased);
+            }
             objects.erase(objects.begin() + i);
         }
     }
 }
 
+void Scene::setSpatialIndex(SpatialIndexType type) {
+    if (type == SpatialIndexType::CYLINDRICAL && cylindricalGrid.points.empty()) {
+        LOG_INFO("building cylindrical grid...");
+        cylindricalGrid = buildCylindricalGrid(grid.points, 20);
+    }
+    spatialIndex = type;
+}
+
+void Scene::setDrawEngine(DrawEngine engine) {
+    if (engine == DrawEngine::SLICE_RASTER && columnGrid.columns.empty()) {
+        LOG_INFO("building column grid...");
+        columnGrid = buildColumnGrid(grid.points);
+    }
+    drawEngine = engine;
+}
+
+bool Scene::waitForKeys(int timeoutMs) {
+    if (shmPointer == nullptr) {
+        if (timeoutMs > 0) usleep(timeoutMs * 1000); // no keyboard, the keys never change
+        return false;
+    }
+    return waitNotify(shmPointer->notify.key, seenKeys, timeoutMs < 0 ? -1 : timeoutMs * 1000000ll);
+}
+
+bool Scene::waitForRevolution(int timeoutMs) {
+    if (shmPointer == nullptr) {
+        usleep(nominalRevolutionNs / 1000);
+        return true;
+    }
+    TraceSpan span("wait revolution", "renderer");
+    bool started = waitNotify(shmPointer->notify.revolution, seenRevolution, timeoutMs < 0 ? -1 : timeoutMs * 1000000ll);
+    seenRevolution = loadNotify(shmPointer->notify.revolution);
+    return started;
+}
+
+void Scene::setFrameFormat(ShmFrameFormat format) {
+    if (ShmSink* shmSink = dynamic_cast<ShmSink*>(sink.get())) {
+        shmSink->setFrameFormat(format);
+    }
+}
+
 KeyboardState Scene::getPressedKeys() {
+    if (shmPointer == nullptr) return {};
+    seenKeys = loadNotify(shmPointer->notify.key); //before reading, so a change in between still wakes waitForKeys
     auto upper =  shmPointer->keyboardState;
     KeyboardState lower;
     for (int i = 0; i < upper.size(); i++) {
@@ -283,3 +449,18 @@ KeyboardState Scene::getPressedKeys() {
     }
     return lower;
 }
+
+vector<KeyEvent> Scene::pollKeyEvents() {
+    if (shmPointer == nullptr) return {};
+    seenKeys = loadNotify(shmPointer->notify.key);
+    vector<ShmKeyEvent> shmEvents;
+    uint32_t lost = readKeyEvents(shmPointer, keyEventCursor, shmEvents);
+    if (lost > 0) {
+        LOG_WARN("dropped %u key events, poll more often", lost);
+    }
+    vector<KeyEvent> events;
+    for (auto& event : shmEvents) {
+        events.push_back({(char) std::tolower(event.key), event.time});
+    }
+    return events;
+}
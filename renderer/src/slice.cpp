@@ -0,0 +1,184 @@
+#include<vector>
+#include<cmath>
+#include<iostream>
+#include<algorithm>
+
+#include "types.h"
+#include "linalg.h"
+#include "slice.h"
+#include "log.h"
+
+using namespace std;
+
+const float unbounded = 1e30;
+
+struct Interval {
+    float lo;
+    float hi;
+    bool isEmpty() const { return lo >= hi; }
+};
+const Interval emptyInterval = { unbounded, -unbounded };
+const Interval fullInterval = { -unbounded, unbounded };
+
+static inline Interval intersect(const Interval& a, const Interval& b) {
+    return { max(a.lo, b.lo), min(a.hi, b.hi) };
+}
+
+//all primitives here are convex, so the union of intervals of their parts is an interval
+static inline Interval hull(const Interval& a, const Interval& b) {
+    if (a.isEmpty()) return b;
+    if (b.isEmpty()) return a;
+    return { min(a.lo, b.lo), max(a.hi, b.hi) };
+}
+
+//u where a*u^2 + b*u + c < 0
+static Interval quadraticBelowZero(float a, float b, float c) {
+    const float epsilon = 1e-6;
+    if (a <= epsilon) {
+        if (abs(b) <= epsilon) return c < 0 ? fullInterval : emptyInterval;
+        float root = -c / b;
+        return b > 0 ? Interval{ -unbounded, root } : Interval{ root, unbounded };
+    }
+    float discriminant = b * b - 4 * a * c;
+    if (discriminant <= 0) return emptyInterval;
+    float sq = sqrt(discriminant);
+    return { (-b - sq) / (2 * a), (-b + sq) / (2 * a) };
+}
+
+//z where a + b*z >= 0
+static Interval halfLine(float a, float b) {
+    const float epsilon = 1e-9;
+    if (abs(b) <= epsilon) return a >= 0 ? fullInterval : emptyInterval;
+    float root = -a / b;
+    return b > 0 ? Interval{ root, unbounded } : Interval{ -unbounded, root };
+}
+
+static Interval sphereInterval(float x, float y, const Vec3<float>& center, float radius2) {
+    float dxy2 = (x - center.x) * (x - center.x) + (y - center.y) * (y - center.y);
+    float h2 = radius2 - dxy2;
+    if (h2 <= 0) return emptyInterval;
+    float h = sqrt(h2);
+    return { center.z - h, center.z + h };
+}
+
+static Interval capsuleInterval(float x, float y, const Vec3<float>& start, const Vec3<float>& end, float radius2) {
+    Interval res = hull(sphereInterval(x, y, start, radius2), sphereInterval(x, y, end, radius2));
+
+    auto vec = end - start;
+    float length2 = magnitude_2(vec);
+    if (length2 <= 0) return res;
+
+    //with u = z - start.z, the squared distance to the axis is a*u^2 + b*u + c
+    float wx = x - start.x;
+    float wy = y - start.y;
+    float k = wx * vec.x + wy * vec.y;
+    float a = 1 - vec.z * vec.z / length2;
+    float b = -2 * k * vec.z / length2;
+    float c = wx * wx + wy * wy - k * k / length2;
+    Interval nearAxis = quadraticBelowZero(a, b, c - radius2);
+
+    //projection onto the axis has to fall strictly between the ends: 0 < k + u*vec.z < length2
+    Interval betweenEnds = intersect(halfLine(k, vec.z), halfLine(length2 - k, -vec.z));
+
+    Interval cylinder = intersect(nearAxis, betweenEnds);
+    if (not cylinder.isEmpty()) res = hull(res, { cylinder.lo + start.z, cylinder.hi + start.z });
+    return res;
+}
+
+ColumnSpan sphereColumnSpan(float x, float y, const Vec3<float>& center, float radius2, float innerRadius2) {
+    Interval outer = sphereInterval(x, y, center, radius2);
+    Interval hole = sphereInterval(x, y, center, innerRadius2);
+    return { outer.lo, outer.hi, hole.lo, hole.hi };
+}
+
+ColumnSpan boxColumnSpan(float x, float y, const Vec3<float>& minV, const Vec3<float>& maxV, float thickness) {
+    if (not (minV.x < x && x < maxV.x && minV.y < y && y < maxV.y)) return { unbounded, -unbounded };
+    ColumnSpan span = { minV.z, maxV.z };
+    if (thickness > 0 &&
+        minV.x + thickness < x && x < maxV.x - thickness &&
+        minV.y + thickness < y && y < maxV.y - thickness) {
+        span.holeLo = minV.z + thickness;
+        span.holeHi = maxV.z - thickness;
+    }
+    return span;
+}
+
+ColumnSpan capsuleColumnSpan(float x, float y, const Vec3<float>& start, const Vec3<float>& end, float radius) {
+    Interval res = capsuleInterval(x, y, start, end, radius * radius);
+    return { res.lo, res.hi };
+}
+
+ColumnSpan triangleColumnSpan(float x, float y, const Vec3<float>& v1, const Vec3<float>& v2, const Vec3<float>& v3, float thickness) {
+    float thickness2 = thickness * thickness;
+    //outside the prism over the triangle the closest point is on an edge
+    Interval res = hull(hull(
+        capsuleInterval(x, y, v1, v2, thickness2),
+        capsuleInterval(x, y, v2, v3, thickness2)),
+        capsuleInterval(x, y, v3, v1, thickness2));
+
+    Vec3<float> normal = cross(v2 - v1, v1 - v3);
+    float magNormal = magnitude_2(normal);
+    if (magNormal <= 0) return { res.lo, res.hi };
+
+    //inside the prism the distance to the plane counts, every constraint is linear in z
+    Vec3<float> centroid = (v1 + v2 + v3) * (1. / 3.);
+    Interval prism = fullInterval;
+    for (auto [a, b] : { pair{v1, v2}, pair{v2, v3}, pair{v3, v1} }) {
+        Vec3<float> edgeNormal = cross(b - a, normal);
+        float side = sgn(dot(edgeNormal, centroid - a));
+        float offset = edgeNormal.x * (x - a.x) + edgeNormal.y * (y - a.y) - edgeNormal.z * a.z;
+        prism = intersect(prism, halfLine(side * offset, side * edgeNormal.z));
+    }
+    // (normal . (p - v1))^2 < thickness^2 * |normal|^2
+    float planeOffset = normal.x * (x - v1.x) + normal.y * (y - v1.y) - normal.z * v1.z;
+    float slab = thickness * sqrt(magNormal);
+    prism = intersect(prism, intersect(halfLine(planeOffset + slab, normal.z), halfLine(slab - planeOffset, -normal.z)));
+
+    res = hull(res, prism);
+    return { res.lo, res.hi };
+}
+
+ColumnGrid buildColumnGrid(const UpdatePattern& points, float cellSize) {
+    ColumnGrid grid;
+    grid.cellSize = cellSize;
+
+    //every column of the pattern has a row 0 point
+    for (const UpdatePatternPoint& pt : points) {
+        if (pt.pointDisplayParams.rowIndex != 0) continue;
+        grid.columns.push_back({ pt.pos.x, pt.pos.y, pt.pos.z, pt.pointDisplayParams, pt.normal });
+    }
+
+    float maxX = -__FLT_MAX__, maxY = -__FLT_MAX__;
+    grid.minX = __FLT_MAX__;
+    grid.minY = __FLT_MAX__;
+    for (const SliceColumn& column : grid.columns) {
+        grid.minX = min(grid.minX, column.x);
+        grid.minY = min(grid.minY, column.y);
+        maxX = max(maxX, column.x);
+        maxY = max(maxY, column.y);
+    }
+    grid.nx = (int) floor((maxX - grid.minX) / cellSize) + 1;
+    grid.ny = (int) floor((maxY - grid.minY) / cellSize) + 1;
+    LOG_DEBUG("column grid: %zu columns in %dx%d cells", grid.columns.size(), grid.nx, grid.ny);
+
+    //counting sort by cell, columns of a slice stay in slice order
+    int nCells = grid.nx * grid.ny;
+    vector<int> cellOfColumn(grid.columns.size());
+    grid.cellStarts.assign(nCells + 1, 0);
+    for (size_t i = 0; i < grid.columns.size(); i++) {
+        int ix = (int) floor((grid.columns[i].x - grid.minX) / cellSize);
+        int iy = (int) floor((grid.columns[i].y - grid.minY) / cellSize);
+        cellOfColumn[i] = ix * grid.ny + iy;
+        grid.cellStarts[cellOfColumn[i] + 1]++;
+    }
+    for (int i = 0; i < nCells; i++) {
+        grid.cellStarts[i + 1] += grid.cellStarts[i];
+    }
+    vector<uint32_t> fill(grid.cellStarts.begin(), grid.cellStarts.end() - 1);
+    vector<SliceColumn> sorted(grid.columns.size());
+    for (size_t i = 0; i < grid.columns.size(); i++) {
+        sorted[fill[cellOfColumn[i]]++] = grid.columns[i];
+    }
+    grid.columns = sorted;
+    return grid;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "shm.h"
+
+using namespace std;
+
+//gpio wiring of the panels, the driver drives these pins and the renderer packs words for them
+constexpr array<int, 6> COLOR_PINS_1 = {11, 27, 7, 8, 9, 10}; // display 1: side 1 rgb, side 2 rgb
+constexpr array<int, 6> COLOR_PINS_2 = {12, 5, 6, 19, 13, 20}; // display 2: side 1 rgb, side 2 rgb
+constexpr int CLOCK_PIN = 17;
+constexpr array<int, 5> ADDRESS_PINS_1 = {22, 23, 24, 25, 15};
+constexpr array<int, 5> ADDRESS_PINS_2 = {2, 3, 21, 26, 14};
+constexpr int LATCH_PIN = 4;
+constexpr int OE_PIN = 18;
+
+//first of the 3 color pins of a panel side in COLOR_PINS_1/2
+inline constexpr const int* sidePins(bool isDisplay1, bool isSide1) {
+    return (isDisplay1 ? COLOR_PINS_1.data() : COLOR_PINS_2.data()) + (isSide1 ? 0 : 3);
+}
+
+//gpio set-mask of a 3 bit color on one panel side, the high bit goes to the first pin
+inline constexpr uint32_t packVoxel(uint8_t color, bool isDisplay1, bool isSide1) {
+    const int* pins = sidePins(isDisplay1, isSide1);
+    return ((color>>2 & 1u)<<pins[0]) | ((color>>1 & 1u)<<pins[1]) | ((color & 1u)<<pins[2]);
+}
+
+//all color bits of one panel side
+inline constexpr uint32_t sideMask(bool isDisplay1, bool isSide1) {
+    return packVoxel(7, isDisplay1, isSide1);
+}
+
+//rows are shifted in top first, so word j holds row 63 - j
+inline void packSlice(const ShmVoxelSlice& slice, ShmPackedSlice& packed) {
+    packed.index1 = slice.index1;
+    packed.index2 = slice.index2;
+    for (int j = 0; j < 64; j++) {
+        packed.rows[j] = packVoxel(slice.data[63-j], true, true) | packVoxel(slice.data[127-j], true, false)
+                        | packVoxel(slice.data[191-j], false, true) | packVoxel(slice.data[255-j], false, false);
+    }
+}
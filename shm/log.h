@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+//leveled logging for the renderer and the driver. calls below LOG_LEVEL compile to nothing, arguments included.
+//the rest are formatted into a lock-free ring and a background thread writes them to stderr,
+//so a call on a hot path costs one snprintf and never waits for the terminal.
+//build with -DLOG_LEVEL=LOG_LEVEL_DEBUG to see the debug messages
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logMessage(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void) 0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) logMessage(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void) 0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) logMessage(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void) 0)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logMessage(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void) 0)
+#endif
+
+const int LOG_RING_SIZE = 1024; // messages, a power of 2
+const int LOG_TEXT_SIZE = 160; // longer messages are cut
+const int LOG_FLUSH_INTERVAL_MS = 5;
+
+struct LogEntry {
+    std::atomic<uint64_t> sequence; // == position while free, position + 1 once written
+    int level;
+    char text[LOG_TEXT_SIZE];
+};
+
+//bounded multi-writer ring, one reader. writers never wait for the reader, a full ring drops debug and info messages and counts them
+class LogRing {
+    std::array<LogEntry, LOG_RING_SIZE> entries;
+    alignas(64) std::atomic<uint64_t> head = 0; // next position for a writer
+    alignas(64) uint64_t tail = 0; // next position for the flusher
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<bool> stopping = false;
+    std::thread flusher;
+
+    bool writeNext(FILE* output) {
+        LogEntry& entry = entries[tail % LOG_RING_SIZE];
+        if (entry.sequence.load(std::memory_order_acquire) != tail + 1) return false;
+        static const char* prefixes[] = { "", "", "warning: ", "error: " };
+        fprintf(output, "%s%s\n", prefixes[entry.level], entry.text);
+        entry.sequence.store(tail + LOG_RING_SIZE, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+    void flush() {
+        bool wrote = false;
+        while (writeNext(stderr)) wrote = true;
+        uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost > 0) {
+            fprintf(stderr, "warning: %llu log messages dropped\n", (unsigned long long) lost);
+            wrote = true;
+        }
+        if (wrote) fflush(stderr);
+    }
+
+    public:
+        LogRing() {
+            for (uint64_t i = 0; i < LOG_RING_SIZE; i++) {
+                entries[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            //started by the first log call, so it runs on the cpus that thread had, the driver logs before pinning itself
+            flusher = std::thread([this]() {
+                while (!stopping.load(std::memory_order_acquire)) {
+                    flush();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+                }
+            });
+        }
+
+        ~LogRing() {
+            stopping.store(true, std::memory_order_release);
+            flusher.join();
+            flush();
+        }
+
+        void push(int level, const char* format, va_list args) {
+            uint64_t position = head.load(std::memory_order_relaxed);
+            while (true) {
+                LogEntry& entry = entries[position % LOG_RING_SIZE];
+                int64_t lag = (int64_t) (entry.sequence.load(std::memory_order_acquire) - position);
+                if (lag == 0) {
+                    if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                } else if (lag < 0) { // the flusher is a whole ring behind
+                    if (level >= LOG_LEVEL_WARN) {
+                        fputs(level == LOG_LEVEL_ERROR ? "error: " : "warning: ", stderr);
+                        vfprintf(stderr, format, args); // rare and not worth losing, written right away out of order
+                        fputc('\n', stderr);
+                    } else {
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    return;
+                } else {
+                    position = head.load(std::memory_order_relaxed);
+                }
+            }
+            LogEntry& entry = entries[position % LOG_RING_SIZE];
+            entry.level = level;
+            vsnprintf(entry.text, LOG_TEXT_SIZE, format, args);
+            entry.sequence.store(position + 1, std::memory_order_release);
+        }
+};
+
+inline LogRing& logRing() {
+    static LogRing ring; // created on first use, also safe from static initializers
+    return ring;
+}
+
+__attribute__((format(printf, 2, 3)))
+inline void logMessage(int level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    logRing().push(level, format, args);
+    va_end(args);
+}
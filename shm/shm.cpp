@@ -6,7 +6,11 @@
 #include<fcntl.h>
 #include<unistd.h>
 #include<cstring>
-#include <assert.h>
+#include <cmath>
+#include <atomic>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 
 
@@ -29,6 +33,9 @@ ShmLayout* initShm(const Header header, const char* name) {
 
     ShmLayout* g_shmPtr = static_cast<ShmLayout*>(ptr);
 
+    if (g_shmPtr->header.signature == header.signature && g_shmPtr->header.version != header.version) {
+        cerr << "initShm: replacing " << name << " layout version " << g_shmPtr->header.version << " with " << header.version << endl;
+    }
     g_shmPtr->header = header;
 
     return g_shmPtr;
@@ -51,7 +58,12 @@ ShmLayout* openShm(const char* name) {
         return nullptr;
     }
     ShmLayout* layoutPtr = static_cast<ShmLayout*>(ptr);
-    assert(layoutPtr->header.signature == 0xB0B);
+    //another version lays the fields out differently, nothing in it can be trusted
+    if (layoutPtr->header.signature != SHM_SIGNATURE || layoutPtr->header.version != SHM_VERSION) {
+        cerr << "openShm: " << name << " has layout version " << layoutPtr->header.version << ", this build needs " << SHM_VERSION << ". Rebuild the driver and apps together." << endl;
+        munmap(ptr, sizeof(ShmLayout));
+        return nullptr;
+    }
 
     return layoutPtr;
 }
@@ -59,4 +71,238 @@ void writeShm(ShmLayout* basePtr, const ShmVoxelFrame& newFrame) {
     if (basePtr) {
         std::memcpy(&basePtr->data, &newFrame, sizeof(ShmVoxelFrame));
     }
-}
\ No newline at end of file
+}
+
+void writeTiming(volatile ShmLayout* basePtr, const ShmTiming& timing) {
+    ShmTimingRecord& record = const_cast<ShmTimingRecord&>(basePtr->timing);
+    atomic_ref<uint32_t> sequence(record.sequence);
+    uint32_t start = sequence.load(memory_order_relaxed);
+    sequence.store(start + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record.timing = timing;
+    sequence.store(start + 2, memory_order_release);
+}
+
+ShmTiming readTiming(volatile ShmLayout* basePtr) {
+    ShmTimingRecord& record = const_cast<ShmTimingRecord&>(basePtr->timing);
+    atomic_ref<uint32_t> sequence(record.sequence);
+    while (true) {
+        uint32_t before = sequence.load(memory_order_acquire);
+        if (before % 2 == 1) continue;
+        ShmTiming timing = record.timing;
+        atomic_thread_fence(memory_order_acquire);
+        if (sequence.load(memory_order_relaxed) == before) return timing;
+    }
+}
+
+//not FUTEX_PRIVATE_FLAG, waiters and wakers are different processes
+static long futex(volatile uint32_t& word, int op, uint32_t value, const timespec* timeout) {
+    return syscall(SYS_futex, const_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+uint32_t loadNotify(volatile uint32_t& word) {
+    return atomic_ref<uint32_t>(const_cast<uint32_t&>(word)).load(memory_order_acquire);
+}
+
+void notifyAll(volatile uint32_t& word) {
+    atomic_ref<uint32_t>(const_cast<uint32_t&>(word)).fetch_add(1, memory_order_release);
+    futex(word, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+bool waitNotify(volatile uint32_t& word, uint32_t seen, int64_t timeoutNs) {
+    auto deadline = chrono::steady_clock::now() + chrono::nanoseconds(timeoutNs);
+    while (loadNotify(word) == seen) {
+        timespec timeout;
+        if (timeoutNs >= 0) {
+            int64_t left = chrono::duration_cast<chrono::nanoseconds>(deadline - chrono::steady_clock::now()).count();
+            if (left <= 0) return false;
+            timeout = { (time_t) (left / 1000000000), (long) (left % 1000000000) };
+        }
+        futex(word, FUTEX_WAIT, seen, timeoutNs >= 0 ? &timeout : nullptr); // returns early if word != seen or on signals
+    }
+    return true;
+}
+
+void pushKeyEvent(volatile ShmLayout* basePtr, char key, int64_t time) {
+    ShmKeyEventRing& ring = const_cast<ShmKeyEventRing&>(basePtr->keyEvents);
+    uint32_t head = atomic_ref<uint32_t>(ring.head).load(memory_order_relaxed);
+    ShmKeyEvent& slot = ring.events[head % KEY_EVENT_CAPACITY];
+    atomic_ref<uint32_t> sequence(slot.sequence);
+    //invalidate the slot first so a reader still on the old event notices the rewrite
+    sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.key = key;
+    slot.time = time;
+    sequence.store(head + 1, memory_order_release);
+    atomic_ref<uint32_t>(ring.head).store(head + 1, memory_order_release);
+    notifyAll(basePtr->notify.key);
+}
+
+uint32_t keyEventHead(volatile ShmLayout* basePtr) {
+    return atomic_ref<uint32_t>(const_cast<uint32_t&>(basePtr->keyEvents.head)).load(memory_order_acquire);
+}
+
+uint32_t readKeyEvents(volatile ShmLayout* basePtr, uint32_t& cursor, vector<ShmKeyEvent>& out) {
+    ShmKeyEventRing& ring = const_cast<ShmKeyEventRing&>(basePtr->keyEvents);
+    uint32_t head = keyEventHead(basePtr);
+    uint32_t lost = 0;
+    if (head - cursor > KEY_EVENT_CAPACITY) {
+        lost = head - cursor - KEY_EVENT_CAPACITY;
+        cursor = head - KEY_EVENT_CAPACITY;
+    }
+    for (; cursor != head; cursor++) {
+        ShmKeyEvent& slot = ring.events[cursor % KEY_EVENT_CAPACITY];
+        atomic_ref<uint32_t> sequence(slot.sequence);
+        if (sequence.load(memory_order_acquire) != cursor + 1) { lost++; continue; }
+        ShmKeyEvent event = slot;
+        atomic_thread_fence(memory_order_acquire);
+        //rewritten while copying, the producer lapped us
+        if (sequence.load(memory_order_relaxed) != cursor + 1) { lost++; continue; }
+        out.push_back(event);
+    }
+    return lost;
+}
+
+static atomic_ref<uint32_t> frameState(ShmQueuedFrame& frame) {
+    return atomic_ref<uint32_t>(frame.state);
+}
+
+//ready frames can be taken by the driver and by resetFrameQueue at the same time
+static bool moveFrameState(ShmQueuedFrame& frame, uint32_t from, uint32_t to) {
+    return frameState(frame).compare_exchange_strong(from, to, memory_order_acq_rel);
+}
+
+int claimQueuedFrame(volatile ShmLayout* basePtr) {
+    ShmFrameQueue& queue = const_cast<ShmFrameQueue&>(basePtr->frameQueue);
+    for (int i = 0; i < FRAME_QUEUE_LENGTH; i++) {
+        if (moveFrameState(queue.frames[i], QUEUED_FREE, QUEUED_WRITING)) return i;
+    }
+    return -1;
+}
+
+int waitQueuedFrame(volatile ShmLayout* basePtr) {
+    while (true) {
+        //the driver frees slots at revolution starts
+        uint32_t seen = loadNotify(basePtr->notify.frameQueue);
+        int slot = claimQueuedFrame(basePtr);
+        if (slot >= 0) return slot;
+        waitNotify(basePtr->notify.frameQueue, seen, 100000000); // timeout in case no driver is running
+    }
+}
+
+void submitQueuedFrame(volatile ShmLayout* basePtr, int slot, int64_t presentTime) {
+    ShmQueuedFrame& frame = const_cast<ShmFrameQueue&>(basePtr->frameQueue).frames[slot];
+    frame.presentTime = presentTime;
+    frameState(frame).store(QUEUED_READY, memory_order_release); // data and presentTime are visible before the driver can pick it
+}
+
+void resetFrameQueue(volatile ShmLayout* basePtr) {
+    for (auto& frame : const_cast<ShmFrameQueue&>(basePtr->frameQueue).frames) {
+        moveFrameState(frame, QUEUED_READY, QUEUED_FREE);
+        moveFrameState(frame, QUEUED_WRITING, QUEUED_FREE);
+    }
+}
+
+uint32_t advanceFrameQueue(volatile ShmLayout* basePtr, int64_t revolutionStart) {
+    ShmFrameQueue& queue = const_cast<ShmFrameQueue&>(basePtr->frameQueue);
+    uint32_t frameCount = loadNotify(basePtr->notify.frame);
+    int newest = -1;
+    for (int i = 0; i < FRAME_QUEUE_LENGTH; i++) {
+        if (frameState(queue.frames[i]).load(memory_order_acquire) != QUEUED_READY) continue;
+        if (queue.frames[i].presentTime > revolutionStart) continue;
+        if (newest < 0 || queue.frames[i].presentTime > queue.frames[newest].presentTime) newest = i;
+    }
+
+    bool freed = false;
+    if (newest >= 0 && moveFrameState(queue.frames[newest], QUEUED_READY, QUEUED_SHOWING)) {
+        //due frames older than the one shown were rendered too late, drop them
+        for (int i = 0; i < FRAME_QUEUE_LENGTH; i++) {
+            if (i == newest || frameState(queue.frames[i]).load(memory_order_acquire) != QUEUED_READY) continue;
+            if (queue.frames[i].presentTime <= queue.frames[newest].presentTime) {
+                freed |= moveFrameState(queue.frames[i], QUEUED_READY, QUEUED_FREE);
+            }
+        }
+        if (queue.showing != FRAME_QUEUE_LIVE) {
+            frameState(queue.frames[queue.showing]).store(QUEUED_FREE, memory_order_release);
+            freed = true;
+        }
+        queue.showing = newest;
+        queue.showingFrame = frameCount;
+    } else if (queue.showing != FRAME_QUEUE_LIVE && frameCount != queue.showingFrame) {
+        frameState(queue.frames[queue.showing]).store(QUEUED_FREE, memory_order_release);
+        queue.showing = FRAME_QUEUE_LIVE;
+        freed = true;
+    }
+    if (freed) notifyAll(basePtr->notify.frameQueue);
+    return queue.showing;
+}
+
+void writeRenderStats(volatile ShmLayout* basePtr, const ShmRenderStats& stats) {
+    ShmRenderStats& shared = const_cast<ShmRenderStats&>(basePtr->renderStats);
+    atomic_ref<uint32_t> sequence(shared.sequence);
+    //apps publish on their own schedules, taking the odd sequence keeps two of them from mixing their numbers
+    uint32_t start = sequence.load(memory_order_relaxed);
+    if (start % 2 == 1 || !sequence.compare_exchange_strong(start, start + 1, memory_order_relaxed)) return;
+    atomic_thread_fence(memory_order_release);
+    ShmRenderStats copy = stats;
+    copy.sequence = start + 1;
+    shared = copy;
+    sequence.store(start + 2, memory_order_release);
+}
+
+int claimLayer(volatile ShmLayout* basePtr, uint32_t owner, int zOrder, ShmBlendMode blend) {
+    ShmLayers& layers = const_cast<ShmLayers&>(basePtr->layers);
+    for (int i = 0; i < LAYER_COUNT; i++) {
+        ShmLayer& layer = layers.layers[i];
+        uint32_t unowned = 0;
+        if (!atomic_ref<uint32_t>(layer.owner).compare_exchange_strong(unowned, owner, memory_order_acq_rel)) continue;
+        //the driver redraws everything when it sees a new owner, order or blend
+        layer.zOrder = zOrder;
+        layer.blend = blend;
+        for (auto& slice : layer.data) {
+            slice.data.fill(0);
+        }
+        markAllDirty(layer.dirty);
+        return i;
+    }
+    return -1;
+}
+
+void markDirty(volatile ShmDirtySlices& dirty, const ShmDirtySlices& slices) {
+    ShmDirtySlices& words = const_cast<ShmDirtySlices&>(dirty);
+    for (int i = 0; i < DIRTY_WORDS; i++) {
+        if (slices[i] != 0) atomic_ref<uint64_t>(words[i]).fetch_or(slices[i], memory_order_release);
+    }
+}
+
+void markAllDirty(volatile ShmDirtySlices& dirty) {
+    ShmDirtySlices all;
+    all.fill(~0ull);
+    markDirty(dirty, all);
+}
+
+ShmDirtySlices takeDirty(volatile ShmDirtySlices& dirty) {
+    ShmDirtySlices& words = const_cast<ShmDirtySlices&>(dirty);
+    ShmDirtySlices taken;
+    for (int i = 0; i < DIRTY_WORDS; i++) {
+        taken[i] = atomic_ref<uint64_t>(words[i]).exchange(0, memory_order_acquire);
+    }
+    return taken;
+}
+
+int64_t timeAtPhase(const ShmRotation& rotation, double phase) {
+    double delta = phase - rotation.phase;
+    double velocity = rotation.velocity;
+    double discriminant = velocity * velocity + 2 * rotation.acceleration * delta;
+    //smaller root of acceleration/2 * t^2 + velocity * t = delta, in the form that stays exact for small acceleration.
+    //a rotor slowing down too much never gets there, then the time of its lowest speed, where the root ends up
+    //anyway as the discriminant reaches 0, so later phases never get earlier times
+    double dt = discriminant > 0 ? 2 * delta / (velocity + sqrt(discriminant)) : -velocity / rotation.acceleration;
+    return rotation.time + (int64_t) (dt * 1e9);
+}
+
+ShmRotation rotationUpTo(const ShmRotation& rotation, double phase) {
+    double delta = phase - rotation.phase;
+    if (rotation.velocity * rotation.velocity + 2 * rotation.acceleration * delta > 0) return rotation;
+    return { rotation.time, rotation.phase, rotation.velocity, 0 };
+}
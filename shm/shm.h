@@ -3,6 +3,7 @@
 #include <array>
 #include <cstdint>
 #include <chrono>
+#include <vector>
 #include "../renderer/include/types.h"
 
 using namespace std;
@@ -31,6 +32,153 @@ struct ShmVoxelSlice {
 
 using ShmVoxelFrame = array<ShmVoxelSlice, 2000>;
 
+//same slice as 64 gpio set-masks in the order the rows are shifted out, see gpioPacking.h
+struct ShmPackedSlice {
+    uint8_t index1;
+    uint8_t index2;
+    array<uint32_t, 64> rows;
+};
+
+using ShmPackedFrame = array<ShmPackedSlice, 2000>;
+
+enum ShmFrameFormat : uint32_t {
+    VOXEL_BYTES = 0, // driver packs data itself
+    PACKED_GPIO = 1, // driver writes packedData as is, data is still kept up to date
+};
+
+const int LATENESS_BUCKETS = 16;
+const int LATENESS_BUCKET_NS = 2000;
+
+//slice timing of the driver, published once per revolution. read it when sequence is even and unchanged after the read
+struct ShmDriverStats {
+    uint32_t sequence; // odd while the driver updates the block
+    uint32_t revolutions;
+    uint64_t slices;
+    uint64_t overruns; // slices whose rows were still being pushed at their end time
+    uint64_t latenessHistogram[LATENESS_BUCKETS]; // slice start to showUntil, LATENESS_BUCKET_NS wide, last bucket open ended
+    //last revolution
+    int64_t worstLateness;
+    uint32_t lastOverruns;
+    uint16_t worstSlice;
+};
+
+//counts and stage times of the last render of an app, see RenderStats in renderer.h. published after every render,
+//read it like ShmDriverStats. with several apps (layers) it holds whichever rendered last
+struct ShmRenderStats {
+    uint32_t sequence; // odd while an app updates the block
+    uint32_t pid; // of the app that rendered
+    uint64_t renders; // by that app so far
+    uint64_t pointsTested;
+    uint64_t pointsEmitted;
+    uint64_t pointsErased;
+    uint32_t objectsRedrawn;
+    uint32_t objects;
+    int64_t transformNs;
+    int64_t cellsNs;
+    int64_t testsNs;
+    int64_t ditherNs;
+    int64_t diffNs;
+    int64_t writeNs;
+    int64_t totalNs;
+};
+
+//rotor phase estimated by the speed regulator at the last interrupter edge
+struct ShmRotation {
+    int64_t time; // steady_clock ns of the edge
+    double phase; // revolutions at time, about whole at an edge
+    double velocity; // revolutions per second, 0 until the first estimate
+    double acceleration; // revolutions per second^2
+};
+
+//revolution timing from the speed regulator, only read and written as a whole through readTiming/writeTiming
+struct ShmTiming {
+    int64_t nextFrameStart;
+    int64_t nextFrameDuration; // 0 until the first revolution is measured
+    ShmRotation rotation;
+};
+
+//seqlock around the timing so start, duration and rotation always come from the same revolution
+struct ShmTimingRecord {
+    uint32_t sequence; // odd while the speed regulator writes
+    ShmTiming timing;
+};
+
+//futex words, the writer bumps one with notifyAll and wakes everyone blocked on it in waitNotify
+struct ShmNotify {
+    uint32_t revolution; // a revolution started, from the speed regulator (the driver with -fps)
+    uint32_t frame; // a render was written to data, from the renderer
+    uint32_t key; // keyboardState changed, from the control panel
+    uint32_t frameQueue; // the driver freed queued frames
+};
+
+const int KEY_EVENT_CAPACITY = 64;
+
+struct ShmKeyEvent {
+    uint32_t sequence; // index of the event + 1 once written, anything else while the slot is being rewritten
+    char key;
+    int64_t time; // steady_clock ns when the control panel received the press
+};
+
+//key presses in order, one producer (control panel), any number of consumers that each keep their own cursor.
+//the producer never waits, a consumer more than KEY_EVENT_CAPACITY events behind loses the oldest ones
+struct ShmKeyEventRing {
+    uint32_t head; // events published so far, the next one goes to slot head % KEY_EVENT_CAPACITY
+    array<ShmKeyEvent, KEY_EVENT_CAPACITY> events;
+};
+
+const int FRAME_QUEUE_LENGTH = 4;
+const uint32_t FRAME_QUEUE_LIVE = UINT32_MAX; // showing value while the driver shows data
+
+enum ShmQueuedFrameState : uint32_t {
+    QUEUED_FREE = 0,
+    QUEUED_WRITING = 1, // the renderer fills it
+    QUEUED_READY = 2, // waits for its presentTime
+    QUEUED_SHOWING = 3, // the driver reads it, until a newer frame replaces it
+};
+
+struct ShmQueuedFrame {
+    uint32_t state; // ShmQueuedFrameState, free and writing belong to the renderer, ready and showing to the driver
+    int64_t presentTime; // steady_clock ns, shown from the first revolution starting at or after it
+    ShmVoxelFrame data; // whole frame, always voxel bytes
+};
+
+//frames rendered ahead of time. at every revolution start the driver switches to the newest ready frame that is due
+//and drops older ones. a live render (notify.frame moving past showingFrame) takes over again from a shown queued frame
+struct ShmFrameQueue {
+    uint32_t showing; // slot the driver shows, FRAME_QUEUE_LIVE for data
+    uint32_t showingFrame; // notify.frame when showing was picked
+    array<ShmQueuedFrame, FRAME_QUEUE_LENGTH> frames;
+};
+
+const int LAYER_COUNT = 3;
+const int DIRTY_WORDS = (2000 + 63) / 64; // one bit per slice
+
+enum ShmBlendMode : uint32_t {
+    BLEND_OVER = 0, // lit voxels replace what is below
+    BLEND_ADD = 1, // color bits are or'ed
+    BLEND_XOR = 2,
+    BLEND_CUT = 3, // lit voxels turn what is below off
+};
+
+using ShmDirtySlices = array<uint64_t, DIRTY_WORDS>; // writers set bits after writing a slice, the compositor takes them
+
+//extra frame for one more client (e.g. a status overlay), merged with data by the driver
+struct ShmLayer {
+    uint32_t owner; // pid of the client, 0 while free. the driver frees layers of clients that exited
+    int32_t zOrder; // data sits at 0, higher is on top
+    ShmBlendMode blend;
+    ShmDirtySlices dirty;
+    ShmVoxelFrame data;
+};
+
+struct ShmLayers {
+    ShmDirtySlices dataDirty; // slices of ShmLayout::data changed since the driver last composited
+    array<ShmLayer, LAYER_COUNT> layers;
+};
+
+const uint32_t SHM_SIGNATURE = 0xB0B;
+const uint16_t SHM_VERSION = 3; // bump with every change to ShmLayout, controlPanel/backend/shm.py too
+
 struct alignas(64) Header {
     uint32_t signature; //4
     uint16_t version; //2
@@ -39,10 +187,17 @@ struct alignas(64) Header {
 
 struct ShmLayout {
     Header header;
-    int64_t nextFrameStart;
-    int64_t nextFrameDuration = 0;
+    ShmTimingRecord timing;
     KeyboardState keyboardState;
     ShmVoxelFrame data;
+    ShmFrameFormat frameFormat;
+    ShmPackedFrame packedData;
+    ShmDriverStats driverStats;
+    ShmNotify notify;
+    ShmKeyEventRing keyEvents;
+    ShmFrameQueue frameQueue;
+    ShmLayers layers;
+    ShmRenderStats renderStats;
 };
 
 ShmLayout* initShm(const Header header, const char* name); //reader opens shm first, sets header, returns base ptr
@@ -50,3 +205,27 @@ ShmLayout* openShm(const char* name); //writer opens shm and returns base ptr
 
 ShmLayout& readShm(const ShmLayout* basePtr);
 void writeShm(ShmLayout* basePtr, const ShmVoxelFrame& shmVoxelFrame);
+
+void writeTiming(volatile ShmLayout* basePtr, const ShmTiming& timing); // single writer
+ShmTiming readTiming(volatile ShmLayout* basePtr); // consistent snapshot, retries while a write is in progress
+uint32_t loadNotify(volatile uint32_t& word);
+void notifyAll(volatile uint32_t& word);
+bool waitNotify(volatile uint32_t& word, uint32_t seen, int64_t timeoutNs = -1); // blocks while word == seen, false on timeout
+void pushKeyEvent(volatile ShmLayout* basePtr, char key, int64_t time); // single producer, wakes notify.key
+uint32_t keyEventHead(volatile ShmLayout* basePtr); // cursor that skips everything published so far
+//appends the events after cursor to out and advances it, returns how many were lost to the producer lapping the cursor
+uint32_t readKeyEvents(volatile ShmLayout* basePtr, uint32_t& cursor, vector<ShmKeyEvent>& out);
+//renderer side of the frame queue, single producer
+int claimQueuedFrame(volatile ShmLayout* basePtr); // a free slot now in QUEUED_WRITING, -1 if the queue is full
+int waitQueuedFrame(volatile ShmLayout* basePtr); // claimQueuedFrame, blocking until the driver frees a slot
+void submitQueuedFrame(volatile ShmLayout* basePtr, int slot, int64_t presentTime);
+void resetFrameQueue(volatile ShmLayout* basePtr); // drops the frames not shown yet, e.g. ones a previous app left behind
+//driver side, call at every revolution start. returns the slot to show or FRAME_QUEUE_LIVE
+uint32_t advanceFrameQueue(volatile ShmLayout* basePtr, int64_t revolutionStart);
+void writeRenderStats(volatile ShmLayout* basePtr, const ShmRenderStats& stats); // skipped while another app is publishing
+int claimLayer(volatile ShmLayout* basePtr, uint32_t owner, int zOrder, ShmBlendMode blend); // layer index, -1 if all are taken
+void markDirty(volatile ShmDirtySlices& dirty, const ShmDirtySlices& slices); // ors slices in
+void markAllDirty(volatile ShmDirtySlices& dirty);
+ShmDirtySlices takeDirty(volatile ShmDirtySlices& dirty); // returns and clears the bits
+int64_t timeAtPhase(const ShmRotation& rotation, double phase); // steady_clock ns at which the rotor reaches phase
+ShmRotation rotationUpTo(const ShmRotation& rotation, double phase); // constant speed instead if the rotor would stop before phase
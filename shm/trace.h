@@ -0,0 +1,241 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "log.h"
+
+//chrome trace-event output (chrome://tracing, ui.perfetto.dev) for the renderer and the driver, off unless
+//VDTRACE names a file. every process appends to that same file and stamps its events with steady_clock,
+//which is one clock for all processes, so app renders and driver revolutions end up on one timeline.
+//events go into a lock-free buffer of the thread that made them and a background thread writes them out,
+//a disabled trace call costs one branch
+const int TRACE_BUFFER_SIZE = 8192; // events per thread, a power of 2
+const int TRACE_FLUSH_INTERVAL_MS = 20;
+
+struct TraceEvent {
+    const char* name; // names and arg names are kept as pointers, string literals only
+    const char* category;
+    char phase; // 'X' span, 'i' instant
+    int64_t start; // steady_clock ns
+    int64_t duration;
+    std::array<const char*, 2> argNames; // nullptr for unused args
+    std::array<int64_t, 2> args;
+};
+
+//one writer, the thread it belongs to, and one reader, the flusher. a full buffer drops events and counts them
+struct TraceBuffer {
+    std::array<TraceEvent, TRACE_BUFFER_SIZE> events;
+    alignas(64) std::atomic<uint64_t> head = 0; // next event the thread writes
+    alignas(64) std::atomic<uint64_t> tail = 0; // next event the flusher reads
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<const char*> threadName = nullptr;
+    const char* writtenName = nullptr; // flusher only, the name the trace has for this thread
+    int tid;
+};
+
+class Tracer {
+    int fd = -1;
+    int pid;
+    std::mutex buffersMutex; // taken when a thread traces for the first time
+    std::vector<TraceBuffer*> buffers; // kept after their thread exits, so the flusher still gets the last events
+    std::string text; // flusher only, one write per flush so processes dont interleave mid event
+    std::atomic<bool> stopping = false;
+    std::thread flusher;
+
+    TraceBuffer* registerThread() {
+        TraceBuffer* buffer = new TraceBuffer();
+        buffer->tid = (int) syscall(SYS_gettid);
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    static void appendTime(std::string& out, int64_t ns) { // microseconds with ns digits, a double would round them
+        char digits[32];
+        snprintf(digits, sizeof(digits), "%lld.%03lld", (long long) (ns / 1000), (long long) (ns % 1000));
+        out += digits;
+    }
+
+    void appendMetadata(const char* kind, int tid, const char* name) {
+        char line[160];
+        snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", kind, pid, tid, name);
+        text += line;
+    }
+
+    void appendEvent(const TraceEvent& event, int tid) {
+        char line[160];
+        snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":", event.name, event.category, event.phase, pid, tid);
+        text += line;
+        appendTime(text, event.start);
+        if (event.phase == 'X') {
+            text += ",\"dur\":";
+            appendTime(text, event.duration);
+        } else {
+            text += ",\"s\":\"t\""; // instants are drawn on their thread
+        }
+        if (event.argNames[0] != nullptr) {
+            text += ",\"args\":{";
+            for (int i = 0; i < 2 && event.argNames[i] != nullptr; i++) {
+                snprintf(line, sizeof(line), "%s\"%s\":%lld", i > 0 ? "," : "", event.argNames[i], (long long) event.args[i]);
+                text += line;
+            }
+            text += "}";
+        }
+        text += "},\n";
+    }
+
+    void flush() {
+        std::vector<TraceBuffer*> current;
+        {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            current = buffers;
+        }
+        for (TraceBuffer* buffer : current) {
+            const char* name = buffer->threadName.load(std::memory_order_acquire);
+            if (name != buffer->writtenName) {
+                appendMetadata("thread_name", buffer->tid, name);
+                buffer->writtenName = name;
+            }
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+            for (; tail != head; tail++) {
+                appendEvent(buffer->events[tail % TRACE_BUFFER_SIZE], buffer->tid);
+            }
+            buffer->tail.store(tail, std::memory_order_release);
+            uint64_t lost = buffer->dropped.exchange(0, std::memory_order_relaxed);
+            if (lost > 0) {
+                LOG_WARN("%llu trace events dropped on thread %d", (unsigned long long) lost, buffer->tid);
+            }
+        }
+        if (text.empty()) return;
+        if (write(fd, text.data(), text.size()) != (ssize_t) text.size()) {
+            LOG_WARN("trace write failed: %s", strerror(errno));
+        }
+        text.clear();
+    }
+
+    public:
+        bool enabled = false;
+
+        Tracer() {
+            const char* path = getenv("VDTRACE");
+            if (path == nullptr || path[0] == '\0') return;
+            //the process that creates the file opens the json array, the closing ] is optional for trace viewers
+            fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+            if (fd >= 0) {
+                text = "[\n";
+            } else {
+                fd = open(path, O_WRONLY | O_APPEND);
+            }
+            if (fd < 0) {
+                LOG_ERROR("can't open trace file %s: %s", path, strerror(errno));
+                return;
+            }
+            pid = getpid();
+            char comm[32] = "";
+            if (FILE* commFile = fopen("/proc/self/comm", "r")) {
+                if (fgets(comm, sizeof(comm), commFile) != nullptr) comm[strcspn(comm, "\n")] = '\0';
+                fclose(commFile);
+            }
+            appendMetadata("process_name", 0, comm);
+            enabled = true;
+            LOG_INFO("tracing to %s", path);
+            //started by the first trace call, like the log flusher it runs on the cpus that thread had
+            flusher = std::thread([this]() {
+                while (!stopping.load(std::memory_order_acquire)) {
+                    flush();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS));
+                }
+            });
+        }
+
+        ~Tracer() {
+            if (!enabled) return;
+            stopping.store(true, std::memory_order_release);
+            flusher.join();
+            flush();
+            close(fd);
+        }
+
+        TraceBuffer& threadBuffer() {
+            thread_local TraceBuffer* buffer = registerThread();
+            return *buffer;
+        }
+
+        void push(const TraceEvent& event) {
+            TraceBuffer& buffer = threadBuffer();
+            uint64_t head = buffer.head.load(std::memory_order_relaxed);
+            if (head - buffer.tail.load(std::memory_order_acquire) >= TRACE_BUFFER_SIZE) {
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            buffer.events[head % TRACE_BUFFER_SIZE] = event;
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+};
+
+inline Tracer& tracer() {
+    static Tracer instance; // created on first use, reads VDTRACE once
+    return instance;
+}
+
+inline bool traceEnabled() {
+    return tracer().enabled;
+}
+
+inline int64_t traceNow() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+//a span with known start and end, e.g. from the driver's own clock
+inline void traceComplete(
+    const char* name, const char* category, int64_t start, int64_t end,
+    const char* argName0 = nullptr, int64_t arg0 = 0, const char* argName1 = nullptr, int64_t arg1 = 0
+) {
+    if (!traceEnabled()) return;
+    tracer().push({ name, category, 'X', start, end - start, { argName0, argName1 }, { arg0, arg1 } });
+}
+
+inline void traceInstant(
+    const char* name, const char* category, int64_t time,
+    const char* argName0 = nullptr, int64_t arg0 = 0, const char* argName1 = nullptr, int64_t arg1 = 0
+) {
+    if (!traceEnabled()) return;
+    tracer().push({ name, category, 'i', time, 0, { argName0, argName1 }, { arg0, arg1 } });
+}
+
+//names the calling thread in the trace
+inline void traceThreadName(const char* name) {
+    if (!traceEnabled()) return;
+    tracer().threadBuffer().threadName.store(name, std::memory_order_release);
+}
+
+//span from construction to the end of the scope, args can be filled in before it ends
+struct TraceSpan {
+    const char* name;
+    const char* category;
+    std::array<const char*, 2> argNames;
+    std::array<int64_t, 2> args;
+    int64_t start;
+
+    TraceSpan(const char* name_, const char* category_, const char* argName0 = nullptr, int64_t arg0 = 0, const char* argName1 = nullptr, int64_t arg1 = 0)
+        : name(name_), category(category_), argNames{ argName0, argName1 }, args{ arg0, arg1 },
+          start(traceEnabled() ? traceNow() : 0) {}
+
+    ~TraceSpan() {
+        if (start != 0) tracer().push({ name, category, 'X', start, traceNow() - start, argNames, args });
+    }
+};
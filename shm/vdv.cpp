@@ -0,0 +1,259 @@
+#include "vdv.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+size_t encodeRle(const uint8_t* in, size_t size, uint8_t* out) {
+    size_t o = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t run = 1;
+        while (i + run < size && run < 129 && in[i + run] == in[i]) run++;
+        if (run >= 3) {
+            out[o++] = (uint8_t) (run + 126);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+        //literals up to the next run of three, shorter runs dont pay for the control byte of the literals after them
+        size_t start = i++;
+        while (i < size && i - start < 128 && !(i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2])) i++;
+        out[o++] = (uint8_t) (i - start - 1);
+        memcpy(out + o, in + start, i - start);
+        o += i - start;
+    }
+    return o;
+}
+
+bool decodeRle(const uint8_t* in, size_t size, uint8_t* out, size_t outSize) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < size) {
+        uint8_t control = in[i++];
+        if (control < 128) {
+            size_t count = control + 1;
+            if (i + count > size || o + count > outSize) return false;
+            memcpy(out + o, in + i, count);
+            i += count;
+            o += count;
+        } else {
+            size_t count = control - 126;
+            if (i >= size || o + count > outSize) return false;
+            memset(out + o, in[i++], count);
+            o += count;
+        }
+    }
+    return o == outSize;
+}
+
+bool VdvWriter::open(const string& path, uint32_t keyframeInterval) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        perror("VdvWriter: fopen failed");
+        return false;
+    }
+    header = {
+        .magic = VDV_MAGIC,
+        .version = VDV_VERSION,
+        .sliceCount = 2000,
+        .sliceBytes = VDV_SLICE_BYTES,
+        .keyframeInterval = max<uint32_t>(keyframeInterval, 1),
+        .frameCount = 0,
+        .indexOffset = 0,
+    };
+    fwrite(&header, sizeof(header), 1, file);
+    offset = sizeof(header);
+    previous.assign(2000, ShmVoxelSlice{});
+    index.clear();
+    return true;
+}
+
+void VdvWriter::addFrame(const ShmVoxelSlice* frame, int64_t time, const ShmDirtySlices* changed) {
+    if (file == nullptr) return;
+    if (index.empty()) firstTime = time;
+    bool isKeyframe = index.size() % header.keyframeInterval == 0;
+    if (isKeyframe) {
+        previous.assign(2000, ShmVoxelSlice{});
+    }
+
+    records.clear();
+    uint32_t sliceCount = 0;
+    uint8_t delta[VDV_SLICE_BYTES];
+    uint8_t encoded[VDV_MAX_ENCODED];
+    for (int s = 0; s < 2000; s++) {
+        if (!isKeyframe && changed != nullptr && !((*changed)[s / 64] >> (s % 64) & 1)) continue;
+        const uint8_t* current = reinterpret_cast<const uint8_t*>(&frame[s]);
+        const uint8_t* before = reinterpret_cast<const uint8_t*>(&previous[s]);
+        bool same = true;
+        for (int i = 0; i < VDV_SLICE_BYTES; i++) {
+            delta[i] = current[i] ^ before[i];
+            same &= delta[i] == 0;
+        }
+        if (same) continue;
+        previous[s] = frame[s];
+
+        uint16_t sliceIndex = s;
+        uint16_t encodedSize = encodeRle(delta, VDV_SLICE_BYTES, encoded);
+        records.insert(records.end(), (uint8_t*) &sliceIndex, (uint8_t*) &sliceIndex + 2);
+        records.insert(records.end(), (uint8_t*) &encodedSize, (uint8_t*) &encodedSize + 2);
+        records.insert(records.end(), encoded, encoded + encodedSize);
+        sliceCount++;
+    }
+
+    VdvFrameHeader frameHeader = { time - firstTime, isKeyframe, sliceCount, records.size() };
+    index.push_back({ offset, frameHeader.time, isKeyframe, 0 });
+    fwrite(&frameHeader, sizeof(frameHeader), 1, file);
+    fwrite(records.data(), 1, records.size(), file);
+    offset += sizeof(frameHeader) + records.size();
+}
+
+void VdvWriter::close() {
+    if (file == nullptr) return;
+    header.frameCount = index.size();
+    header.indexOffset = offset;
+    fwrite(index.data(), sizeof(VdvIndexEntry), index.size(), file);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    file = nullptr;
+}
+
+bool VdvReader::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        perror("VdvReader: open failed");
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    size = info.st_size;
+    if (size < sizeof(VdvHeader)) {
+        LOG_ERROR("%s is too short for a vdv file", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void* ptr = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        perror("VdvReader: mmap failed");
+        return false;
+    }
+    data = static_cast<const uint8_t*>(ptr);
+
+    const VdvHeader& header = *reinterpret_cast<const VdvHeader*>(data);
+    if (header.magic != VDV_MAGIC || header.version != VDV_VERSION || header.sliceCount != 2000 || header.sliceBytes != VDV_SLICE_BYTES) {
+        LOG_ERROR("%s is not a vdv file this build can play", path.c_str());
+        close();
+        return false;
+    }
+    bool indexed = header.indexOffset != 0 && header.indexOffset <= size
+        && header.frameCount <= (size - header.indexOffset) / sizeof(VdvIndexEntry);
+    if (indexed) {
+        //the index follows the compressed frames, so it is not aligned for VdvIndexEntry
+        index.resize(header.frameCount);
+        memcpy(index.data(), data + header.indexOffset, header.frameCount * sizeof(VdvIndexEntry));
+        //a damaged index would send applyFrame past the end of the mapping
+        VdvFrameHeader frameHeader;
+        indexed = all_of(index.begin(), index.end(), [&](const VdvIndexEntry& entry) { return frameFits(entry.offset, size, frameHeader); });
+    }
+    if (!indexed) {
+        LOG_WARN("%s has no usable index, scanning frames", path.c_str());
+        //a damaged index still marks where the frames end
+        scanFrames(header.indexOffset != 0 && header.indexOffset <= size ? header.indexOffset : size);
+    }
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    state.assign(2000, ShmVoxelSlice{});
+    decoded = -1;
+    return true;
+}
+
+bool VdvReader::frameFits(uint64_t offset, uint64_t end, VdvFrameHeader& frameHeader) const {
+    if (offset > end || end - offset < sizeof(VdvFrameHeader)) return false;
+    memcpy(&frameHeader, data + offset, sizeof(frameHeader));
+    return frameHeader.size <= end - offset - sizeof(frameHeader);
+}
+
+void VdvReader::scanFrames(uint64_t end) {
+    index.clear();
+    uint64_t offset = sizeof(VdvHeader);
+    VdvFrameHeader frameHeader;
+    while (frameFits(offset, end, frameHeader)) { // stops at the end or at a frame cut off by the writer
+        index.push_back({ offset, frameHeader.time, frameHeader.isKeyframe, 0 });
+        offset += sizeof(frameHeader) + frameHeader.size;
+    }
+}
+
+void VdvReader::close() {
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    index.clear();
+    decoded = -1;
+}
+
+int64_t VdvReader::duration() const {
+    if (index.empty()) return 0;
+    int64_t last = index.back().time;
+    return index.size() > 1 ? last + last / (int64_t) (index.size() - 1) : last;
+}
+
+size_t VdvReader::frameAt(int64_t time) const {
+    auto after = upper_bound(index.begin(), index.end(), time, [](int64_t t, const VdvIndexEntry& entry) { return t < entry.time; });
+    return after == index.begin() ? 0 : after - index.begin() - 1;
+}
+
+bool VdvReader::applyFrame(size_t frame) {
+    const VdvIndexEntry& entry = index[frame];
+    VdvFrameHeader frameHeader;
+    memcpy(&frameHeader, data + entry.offset, sizeof(frameHeader));
+    if (frameHeader.isKeyframe) {
+        state.assign(2000, ShmVoxelSlice{});
+    }
+    const uint8_t* record = data + entry.offset + sizeof(frameHeader);
+    const uint8_t* end = record + frameHeader.size;
+    uint8_t delta[VDV_SLICE_BYTES];
+    for (uint32_t i = 0; i < frameHeader.sliceCount; i++) {
+        uint16_t sliceIndex, encodedSize;
+        if (record + 4 > end) return false;
+        memcpy(&sliceIndex, record, 2);
+        memcpy(&encodedSize, record + 2, 2);
+        record += 4;
+        if (sliceIndex >= 2000 || record + encodedSize > end) return false;
+        if (!decodeRle(record, encodedSize, delta, VDV_SLICE_BYTES)) return false;
+        uint8_t* slice = reinterpret_cast<uint8_t*>(&state[sliceIndex]);
+        for (int b = 0; b < VDV_SLICE_BYTES; b++) {
+            slice[b] ^= delta[b];
+        }
+        record += encodedSize;
+    }
+    return true;
+}
+
+const ShmVoxelSlice* VdvReader::readFrame(size_t frame) {
+    if (frame >= index.size()) return nullptr;
+    if (decoded >= 0 && frame == (size_t) decoded) return state.data();
+    size_t start = frame;
+    if (decoded < 0 || frame != (size_t) decoded + 1) {
+        while (start > 0 && !index[start].isKeyframe) start--;
+        state.assign(2000, ShmVoxelSlice{});
+    }
+    for (size_t f = start; f <= frame; f++) {
+        if (!applyFrame(f)) {
+            LOG_ERROR("vdv frame %zu is corrupt", f);
+            decoded = -1;
+            return nullptr;
+        }
+        decoded = f;
+    }
+    return state.data();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "shm.h"
+
+using namespace std;
+
+//.vdv volumetric video, a sequence of timestamped ShmVoxelFrames.
+//each slice is stored as the xor against the same slice of the previous frame (of black for keyframes),
+//run length encoded. unchanged slices are left out, so a mostly static scene costs next to nothing
+/*
+FILE LAYOUT
+VdvHeader
+frames, each: VdvFrameHeader, then per stored slice: uint16 slice index, uint16 encoded size, encoded bytes
+index: VdvIndexEntry per frame at header.indexOffset, written last. 0 if the writer didnt finish, the reader then scans the frames
+*/
+
+const uint32_t VDV_MAGIC = 0x31564456; // "VDV1"
+const uint16_t VDV_VERSION = 1;
+const int VDV_SLICE_BYTES = sizeof(ShmVoxelSlice);
+const int VDV_MAX_ENCODED = VDV_SLICE_BYTES + (VDV_SLICE_BYTES + 127) / 128; // all literals
+
+struct VdvHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sliceCount;
+    uint32_t sliceBytes;
+    uint32_t keyframeInterval;
+    uint64_t frameCount;
+    uint64_t indexOffset;
+};
+
+struct VdvFrameHeader {
+    int64_t time; // ns since the first frame
+    uint32_t isKeyframe;
+    uint32_t sliceCount; // stored slices
+    uint64_t size; // bytes of slice records after this header
+};
+
+struct VdvIndexEntry {
+    uint64_t offset; // of the VdvFrameHeader
+    int64_t time;
+    uint32_t isKeyframe;
+    uint32_t reserved;
+};
+
+//packbits: a control byte below 128 is followed by that many + 1 literal bytes, from 128 up it repeats the next byte (control - 126) times
+size_t encodeRle(const uint8_t* in, size_t size, uint8_t* out);
+bool decodeRle(const uint8_t* in, size_t size, uint8_t* out, size_t outSize); // false if the input doesnt decode to exactly outSize bytes
+
+class VdvWriter {
+    public:
+        bool open(const string& path, uint32_t keyframeInterval = 48);
+        //time in any steady clock ns, stored relative to the first frame.
+        //changed limits the comparison to these slices, the rest are taken as unchanged (keyframes compare all)
+        void addFrame(const ShmVoxelSlice* frame, int64_t time, const ShmDirtySlices* changed = nullptr);
+        void close(); // writes the index and completes the header
+        uint64_t bytesWritten() const { return offset; }
+
+        ~VdvWriter() { close(); }
+    private:
+        FILE* file = nullptr;
+        VdvHeader header = {};
+        uint64_t offset = 0;
+        int64_t firstTime = 0;
+        vector<ShmVoxelSlice> previous;
+        vector<VdvIndexEntry> index;
+        vector<uint8_t> records; // slice records of the frame being written
+};
+
+class VdvReader {
+    public:
+        bool open(const string& path); // maps the file read only
+        void close();
+        size_t frameCount() const { return index.size(); }
+        int64_t frameTime(size_t frame) const { return index[frame].time; }
+        int64_t duration() const; // last frame time plus one average frame gap, for looping
+        size_t frameAt(int64_t time) const; // last frame shown at time
+
+        //decodes a frame and returns its 2000 slices, valid until the next call.
+        //the next frame after the last one costs one delta, any other replays from the keyframe before it
+        const ShmVoxelSlice* readFrame(size_t frame);
+
+        ~VdvReader() { close(); }
+    private:
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        vector<VdvIndexEntry> index;
+        vector<ShmVoxelSlice> state;
+        long decoded = -1; // frame in state
+
+        bool frameFits(uint64_t offset, uint64_t end, VdvFrameHeader& frameHeader) const; // false if the frame at offset runs past end
+        bool applyFrame(size_t frame);
+        void scanFrames(uint64_t end); // rebuilds the index from the frames before end, if the writer didnt close the file or the index is damaged
+};
@@ -0,0 +1,91 @@
+#include "shm.h"
+#include "vdv.h"
+#include "compositor.h"
+#include "io.h"
+#include "frameView.h"
+#include "../apps/utils/utils.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+//what the display would show, without the display: the lit voxels of a .vdv frame or of the frame in shm,
+//placed in world space with the update pattern. writes them as a point cloud or orthographic images and
+//compares them to a golden point cloud, so renderer changes can be checked voxel for voxel
+const char* axisNames[] = { "top", "front", "side" };
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv, argv + argc);
+    auto hasOption = [&](const string& name) { return find(args.begin(), args.end(), name) != args.end(); };
+    bool fromShm = hasOption("-shm");
+    if (argc < 2 || (!fromShm && args[1][0] == '-')) {
+        cerr<<"usage: ./build/main (video.vdv | -shm) [-frame n] [-pattern output.txt] [-ply voxels.ply] [-images prefix] [-scale pixels-per-unit] [-expect golden.ply]"<<endl;
+        return 2;
+    }
+    string patternPath = hasOption("-pattern") ? getOption<string>("-pattern", argc, argv) : "../update_pattern_gen/output.txt";
+    float scale = hasOption("-scale") ? getOption<float>("-scale", argc, argv) : 4;
+
+    vector<ShmVoxelSlice> frame(2000);
+    VdvReader video;
+    string source;
+    if (fromShm) {
+        volatile ShmLayout* shmPointer = openShm("vdshm");
+        if (shmPointer == nullptr) return 2;
+        //the frame the driver shows, taken like the recorder does
+        Compositor compositor(false);
+        uint32_t showing;
+        do {
+            showing = shmPointer->frameQueue.showing;
+            volatile ShmVoxelFrame& base = showing == FRAME_QUEUE_LIVE ? shmPointer->data : const_cast<ShmFrameQueue&>(shmPointer->frameQueue).frames[showing].data;
+            const ShmVoxelSlice* shown = compositor.compose(shmPointer, const_cast<ShmVoxelFrame&>(base), false);
+            copy(shown, shown + 2000, frame.begin());
+        } while (showing != shmPointer->frameQueue.showing);
+        source = "shm";
+    } else {
+        if (!video.open(args[1]) || video.frameCount() == 0) {
+            cerr<<"no frames in "<<args[1]<<endl;
+            return 2;
+        }
+        size_t frameIndex = hasOption("-frame") ? getOption<int>("-frame", argc, argv) : video.frameCount() - 1;
+        if (frameIndex >= video.frameCount()) {
+            cerr<<args[1]<<" has "<<video.frameCount()<<" frames"<<endl;
+            return 2;
+        }
+        const ShmVoxelSlice* slices = video.readFrame(frameIndex);
+        if (slices == nullptr) return 2;
+        copy(slices, slices + 2000, frame.begin());
+        source = args[1] + " frame " + to_string(frameIndex);
+    }
+
+    FrameView view(loadUpdatePattern(patternPath));
+    auto start = chrono::steady_clock::now();
+    size_t unplaced;
+    vector<LitVoxel> voxels = view.litVoxels(frame.data(), &unplaced);
+    double reconstructMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("%s: %zu voxels lit, %zu bytes without a pattern position (%.2f ms)\n", source.c_str(), voxels.size(), unplaced, reconstructMs);
+
+    if (hasOption("-ply")) {
+        writeLitVoxels(voxels, getOption<string>("-ply", argc, argv));
+    }
+    if (hasOption("-images")) {
+        string prefix = getOption<string>("-images", argc, argv);
+        for (int axis = 0; axis < 3; axis++) {
+            writePpm(view.project(voxels, (ProjectionAxis) axis, scale), prefix + "_" + axisNames[axis] + ".ppm");
+        }
+    }
+    if (hasOption("-expect")) {
+        string goldenPath = getOption<string>("-expect", argc, argv);
+        vector<LitVoxel> expected;
+        if (!readLitVoxels(goldenPath, expected)) {
+            cerr<<"can't read "<<goldenPath<<", write it with -ply"<<endl;
+            return 2;
+        }
+        VoxelDiff diff = diffLitVoxels(expected, voxels);
+        if (diff.missing + diff.extra + diff.recolored > 0) {
+            printf("differs from %s: %zu voxels missing, %zu extra, %zu recolored\n", goldenPath.c_str(), diff.missing, diff.extra, diff.recolored);
+            return 1;
+        }
+        printf("matches %s\n", goldenPath.c_str());
+    }
+}
@@ -1,4 +1,5 @@
 #include "shm.h"
+#include "rotationEstimator.h"
 #include <chrono>
 #include <wiringPi.h>
 
@@ -11,22 +12,31 @@ const float minFps = 0.5;
 
 int main() {
     volatile ShmLayout* shmPointer = openShm("vdshm");
+    if (shmPointer == nullptr) return 1;
     wiringPiSetupGpio();
     pinMode(dataPin, INPUT);
 
     int64_t lastFrameStart;
     int frameNum = 0;
+    RotationEstimator rotationEstimator;
     printf("speed regulator setup succesfully\n");
     while (true) {
         auto currentTime = chrono::time_point_cast<chrono::nanoseconds>(chrono::steady_clock::now()).time_since_epoch().count();
+        //the first pass starts before any edge was waited for, its time is no edge
+        bool hasEstimate = frameNum >= 1 && rotationEstimator.addEdge(currentTime);
 
         if (frameNum >= 1) {
             auto frameDuration =  chrono::steady_clock::now().time_since_epoch().count() - lastFrameStart;
             float fps = 1000000000.0/frameDuration;
             printf("frame duration: %ld, fps: %f\n", frameDuration, 1000000000.0/frameDuration);
             if (fps > minFps) {
-                shmPointer->nextFrameStart = currentTime;
-                shmPointer->nextFrameDuration = frameDuration;
+                ShmTiming timing = {
+                    .nextFrameStart = currentTime,
+                    .nextFrameDuration = frameDuration,
+                    .rotation = hasEstimate ? rotationEstimator.getEstimate() : ShmRotation{},
+                };
+                writeTiming(shmPointer, timing);
+                notifyAll(shmPointer->notify.revolution);
             }
         }
         lastFrameStart = currentTime;
@@ -0,0 +1,50 @@
+#include <cmath>
+#include <cstdio>
+#include "rotationEstimator.h"
+
+using namespace std;
+
+const double nsPerSecond = 1e9;
+const double maxPhaseError = 0.25; // revolutions, a bigger miss means a skipped or doubled edge
+
+bool RotationEstimator::addEdge(int64_t time) {
+    edges[nEdges % historySize] = time;
+    nEdges++;
+    revolution++;
+
+    if (!isLocked) {
+        if (nEdges < 3) return false;
+        //velocity from the last interval, acceleration from the last two
+        int64_t t0 = edges[(nEdges - 3) % historySize];
+        int64_t t1 = edges[(nEdges - 2) % historySize];
+        int64_t t2 = edges[(nEdges - 1) % historySize];
+        double dt1 = (t1 - t0) / nsPerSecond;
+        double dt2 = (t2 - t1) / nsPerSecond;
+        double velocity = 1 / dt2;
+        estimate = { time, (double) revolution, velocity, (velocity - 1 / dt1) / ((dt1 + dt2) / 2) };
+        isLocked = true;
+        return true;
+    }
+
+    double dt = (time - estimate.time) / nsPerSecond;
+    double predictedPhase = estimate.phase + estimate.velocity * dt + estimate.acceleration * dt * dt / 2;
+    double predictedVelocity = estimate.velocity + estimate.acceleration * dt;
+    double residual = revolution - predictedPhase;
+
+    if (abs(residual) > maxPhaseError) {
+        printf("rotation estimate lost (phase error %f), relocking\n", residual);
+        isLocked = false;
+        estimate = {}; // no stale estimate while relocking
+        nEdges = 0;
+        revolution = 0;
+        return addEdge(time);
+    }
+
+    double beta = 2 * (2 - alpha) - 4 * sqrt(1 - alpha);
+    double gamma = beta * beta / (2 * alpha);
+    estimate.time = time;
+    estimate.phase = predictedPhase + alpha * residual;
+    estimate.velocity = predictedVelocity + beta * residual / dt;
+    estimate.acceleration = estimate.acceleration + 2 * gamma * residual / (dt * dt);
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "shm.h"
+
+//tracks the rotor phase from one interrupter edge per revolution with an alpha-beta-gamma filter
+//(steady state kalman filter for constant acceleration), so the driver can follow speed changes within a revolution
+class RotationEstimator {
+    static const int historySize = 8;
+    std::array<int64_t, historySize> edges; // ring of the last edge times, ns
+    int nEdges = 0;
+    int64_t revolution = 0; // revolutions counted since the last lock
+    bool isLocked = false;
+    ShmRotation estimate = {};
+
+    public:
+        //phase gain, velocity and acceleration gains follow from it (kalata relations for a critically damped tracker)
+        double alpha = 0.5;
+
+        //returns false while there are too few edges to estimate
+        bool addEdge(int64_t time);
+        const ShmRotation& getEstimate() const { return estimate; }
+};